@@ -0,0 +1,128 @@
+#include "CommandTrie.h"
+#include <string.h>
+
+#define TRIE_MAX_DEPTH		(64)
+
+namespace {
+
+inline bool
+isNumber(char ch)
+{
+	return ch == '-' || (ch >= '0' && ch <= '9');
+}
+
+};
+
+namespace gdb {
+
+CommandTrie::CommandTrie()
+{
+	clear();
+}
+
+CommandTrie::~CommandTrie()
+{
+}
+
+void
+CommandTrie::clear()
+{
+	children.assign(1, map<char, int>());
+	values.assign(1, -1);
+	nodes.clear();
+	labels.clear();
+	targets.clear();
+}
+
+void
+CommandTrie::insert(const string& cmd, int value)
+{
+	int node = 0;
+
+	for(size_t i = 0; i < cmd.length(); i++) {
+		map<char, int>::const_iterator child = children[node].find(cmd[i]);
+
+		if(child == children[node].end()) {
+			children[node][cmd[i]] = children.size();
+			node = children.size();
+			children.push_back(map<char, int>());
+			values.push_back(-1);
+		} else {
+			node = child->second;
+		}
+	}
+	values[node] = value;
+}
+
+void
+CommandTrie::compile()
+{
+	//one node array, the edges of a node stored next to each other
+	nodes.resize(children.size());
+	labels.clear();
+	targets.clear();
+
+	for(size_t i = 0; i < children.size(); i++) {
+		nodes[i].value = values[i];
+		nodes[i].edges = labels.length();
+		nodes[i].count = children[i].size();
+
+		for(map<char, int>::const_iterator child = children[i].begin(); child != children[i].end(); ++child) {
+			labels  += child->first;
+			targets.push_back(child->second);
+		}
+	}
+}
+
+int
+CommandTrie::match(const char* buf, size_t n, Match* matches, int max) const
+{
+	Match  found[TRIE_MAX_DEPTH];
+	int    count = 0;
+	size_t node  = 0;
+
+	if(nodes.empty()) {
+		return 0;
+	}
+
+	for(size_t i = 0; ; i++) {
+		const Node& current = nodes[node];
+
+		if(current.value >= 0 && i > 0 && count < TRIE_MAX_DEPTH) {
+			Match& m = found[count];
+
+			m.value   = current.value;
+			m.cmd_len = i;
+
+			if(i == n) {
+				m.param = n;
+				count++;
+			} else if(buf[i] == ':' || buf[i] == ';' || buf[i] == ',') {
+				m.param = i + 1;
+				count++;
+			} else if(i == 1 || (isNumber(buf[i]) && !isNumber(buf[i - 1]))) {
+				m.param = i;
+				count++;
+			}
+		}
+		if(i == n || current.count == 0) {
+			break;
+		}
+
+		const char* edge = (const char*) ::memchr(labels.data() + current.edges, buf[i], current.count);
+
+		if(edge == NULL) {
+			break;
+		}
+		node = targets[edge - labels.data()];
+	}
+
+	int stored = 0;
+
+	while(count > 0 && stored < max) {
+		matches[stored++] = found[--count];
+	}
+	return stored;
+}
+
+}; //namespace gdb
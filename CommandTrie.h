@@ -0,0 +1,61 @@
+#ifndef __CommandTrie__h__
+#define __CommandTrie__h__
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+namespace gdb {
+
+	//registered command names, matched against a packet in one forward pass;
+	//a command matches where it is followed by the end of the packet, a ':',
+	//';' or ',' delimiter, the start of a number, or when it is the first byte
+	class CommandTrie
+	{
+		struct Node
+		{
+			int    value;	//-1 if no command ends here
+			size_t edges;	//first edge in labels/targets
+			size_t count;
+		};
+
+		//built by insert(), flattened by compile()
+		vector< map<char, int> > children;
+		vector<int>              values;
+
+		vector<Node>             nodes;
+		string                   labels;
+		vector<int>              targets;
+
+	public:
+		struct Match
+		{
+			int    value;
+			size_t cmd_len;
+			size_t param;	//offset of the parameters, past a delimiter
+		};
+
+		CommandTrie();
+
+		~CommandTrie();
+
+		void
+		clear();
+
+		void
+		insert(const string& cmd, int value);
+
+		void
+		compile();
+
+		//stores up to max matches, longest first; returns how many
+		int
+		match(const char* buf, size_t n, Match* matches, int max) const;
+	};
+
+}; //namespace gdb
+
+#endif/*__CommandTrie__h__*/
@@ -0,0 +1,488 @@
+#include "Crc32.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <vector>
+#include <deque>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC_X86	1
+#endif
+
+#define CRC_POLY		(0x04c11db7)
+
+#define CRC_READ_SIZE		(1 << 20)	//bytes copied out of the backend at a time
+
+namespace gdb {
+
+namespace {
+
+//x^n mod P, as a 32-bit polynomial
+uint32_t
+xpow(int n)
+{
+	uint64_t r = 1;
+
+	for(; n > 0; n--) {
+		r <<= 1;
+
+		if(r & 0x100000000ULL) {
+			r ^= 0x100000000ULL | CRC_POLY;
+		}
+	}
+	return r;
+}
+
+//a * b mod P
+uint32_t
+mulmod(uint32_t a, uint32_t b)
+{
+	uint32_t r = 0;
+
+	for(int i = 31; i >= 0; i--) {
+		r = (r & 0x80000000)? (r << 1) ^ CRC_POLY: r << 1;
+
+		if(b & (1U << i)) {
+			r ^= a;
+		}
+	}
+	return r;
+}
+
+struct Tables
+{
+	uint32_t bytes[256];
+	uint32_t k128[2];	//x^(128+64) mod P, x^128 mod P
+	uint32_t k512[2];	//x^(512+64) mod P, x^512 mod P
+	uint32_t k256[2];
+	uint32_t k384[2];
+	bool     clmul;
+
+	Tables()
+	{
+		for(uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i << 24;
+
+			for(int j = 0; j < 8; j++) {
+				c = (c & 0x80000000)? (c << 1) ^ CRC_POLY: c << 1;
+			}
+			bytes[i] = c;
+		}
+		k128[0] = xpow(128 + 64), k128[1] = xpow(128);
+		k256[0] = xpow(256 + 64), k256[1] = xpow(256);
+		k384[0] = xpow(384 + 64), k384[1] = xpow(384);
+		k512[0] = xpow(512 + 64), k512[1] = xpow(512);
+#if CRC_X86
+		clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#else
+		clmul = false;
+#endif
+	}
+};
+
+const Tables tables;
+
+uint32_t
+updateTable(uint32_t crc, const unsigned char* p, size_t len)
+{
+	for(size_t i = 0; i < len; i++) {
+		crc = (crc << 8) ^ tables.bytes[(crc >> 24) ^ p[i]];
+	}
+	return crc;
+}
+
+#if CRC_X86
+
+//a 128-bit block as a polynomial: bit 127 is the MSB of the first byte
+__attribute__((target("ssse3"))) inline __m128i
+load(const unsigned char* p)
+{
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) p), reverse);
+}
+
+//x * x^d mod P, reduced to 96 bits: hi * (x^(d+64) mod P) + lo * (x^d mod P)
+__attribute__((target("pclmul,ssse3"))) inline __m128i
+fold(__m128i x, const uint32_t k[2])
+{
+	__m128i kk = _mm_set_epi64x(k[0], k[1]);
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, kk, 0x11), _mm_clmulepi64_si128(x, kk, 0x00));
+}
+
+__attribute__((target("pclmul,ssse3"))) uint32_t
+updateClmul(uint32_t crc, const unsigned char* p, size_t len)
+{
+	//the initial value enters as the top 32 bits of the message
+	unsigned char head[16];
+
+	::memcpy(head, p, 16);
+	head[0] ^= crc >> 24, head[1] ^= crc >> 16, head[2] ^= crc >> 8, head[3] ^= crc;
+
+	__m128i x0 = load(head);
+	__m128i x1 = load(p + 16);
+	__m128i x2 = load(p + 32);
+	__m128i x3 = load(p + 48);
+
+	p += 64, len -= 64;
+
+	for(; len >= 64; p += 64, len -= 64) {
+		x0 = _mm_xor_si128(fold(x0, tables.k512), load(p));
+		x1 = _mm_xor_si128(fold(x1, tables.k512), load(p + 16));
+		x2 = _mm_xor_si128(fold(x2, tables.k512), load(p + 32));
+		x3 = _mm_xor_si128(fold(x3, tables.k512), load(p + 48));
+	}
+
+	__m128i x = _mm_xor_si128(
+		_mm_xor_si128(fold(x0, tables.k384), fold(x1, tables.k256)),
+		_mm_xor_si128(fold(x2, tables.k128), x3));
+
+	for(; len >= 16; p += 16, len -= 16) {
+		x = _mm_xor_si128(fold(x, tables.k128), load(p));
+	}
+
+	//the 128-bit remainder and the tail go through the table, starting from 0
+	const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	unsigned char rest[16];
+
+	_mm_storeu_si128((__m128i*) rest, _mm_shuffle_epi8(x, reverse));
+
+	return updateTable(updateTable(0, rest, 16), p, len);
+}
+
+#endif/*CRC_X86*/
+
+void
+computeSlice(Memory* memory, Crc32::Slice* slice)
+{
+	vector<unsigned char> buf(slice->len < CRC_READ_SIZE? slice->len: CRC_READ_SIZE);
+	uint64_t              done  = 0;
+
+	slice->valid = true;
+
+	while(done < slice->len) {
+		size_t n = buf.size();
+
+		if(n > slice->len - done) {
+			n = slice->len - done;
+		}
+		if(memory->read(slice->addr + done, buf.data(), n) < n) {
+			slice->valid = false;
+			break;
+		}
+		slice->crc = Crc32::update(slice->crc, buf.data(), n);
+		done      += n;
+	}
+}
+
+void
+wakeup(int fd)
+{
+	uint64_t one = 1;
+
+	if(::write(fd, &one, sizeof(one)) < 0) {
+		//the counter is saturated, the poller is woken anyway
+	}
+}
+
+};
+
+uint32_t
+Crc32::update(uint32_t crc, const void* buf, size_t len)
+{
+#if CRC_X86
+	if(len >= 128 && tables.clmul) {
+		return updateClmul(crc, (const unsigned char*) buf, len);
+	}
+#endif
+	return updateTable(crc, (const unsigned char*) buf, len);
+}
+
+uint32_t
+Crc32::combine(uint32_t crc, uint32_t next, uint64_t len)
+{
+	//crc * x^(8 * len) mod P, by squaring x^8
+	uint32_t power = xpow(8);
+	uint32_t shift = 1;
+
+	for(; len > 0; len >>= 1) {
+		if(len & 1) {
+			shift = mulmod(shift, power);
+		}
+		power = mulmod(power, power);
+	}
+	return next ^ mulmod(crc, shift);
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//	class Crc32::Pool
+//
+
+//threads started once, on the first large qCRC, and kept for the next ones;
+//shared by the session loops of every worker
+class Crc32::Pool
+{
+	pthread_mutex_t lock;		//also guards the tasks given to the pool
+	pthread_cond_t  ready;		//a task was queued
+	pthread_cond_t  idle;		//a task has no slice being computed
+	deque<Task*>    queue;		//tasks with slices left, taking turns
+	size_t          threads;
+
+	static void*
+	run(void* arg);
+
+	Pool(size_t count);
+
+public:
+	//never destroyed: its threads outlive every caller
+	static Pool*
+	getInstance();
+
+	//0 if none could be started: the callers compute everything themselves
+	size_t
+	size() const;
+
+	void
+	submit(Task* task);
+
+	//takes task out of the queue, waits for the slices being computed
+	void
+	cancel(Task* task);
+
+	bool
+	isDone(Task* task);
+};
+
+Crc32::Pool::Pool(size_t count)
+{
+	pthread_attr_t attr;
+	pthread_t      thread;
+
+	::pthread_mutex_init(&lock, NULL);
+	::pthread_cond_init(&ready, NULL);
+	::pthread_cond_init(&idle, NULL);
+	::pthread_attr_init(&attr);
+	::pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for(threads = 0; threads < count; threads++) {
+		if(::pthread_create(&thread, &attr, run, this) != 0) {
+			break;
+		}
+	}
+	::pthread_attr_destroy(&attr);
+}
+
+Crc32::Pool*
+Crc32::Pool::getInstance()
+{
+	static long  cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+	static Pool* pool = new Pool(cpus > 1? cpus - 1: 0);
+
+	return pool;
+}
+
+void*
+Crc32::Pool::run(void* arg)
+{
+	Pool* pool = (Pool*) arg;
+	Slice slice;
+
+	::pthread_mutex_lock(&pool->lock);
+
+	for(;;) {
+		while(pool->queue.empty()) {
+			::pthread_cond_wait(&pool->ready, &pool->lock);
+		}
+
+		Task* task = pool->queue.front();
+
+		pool->queue.pop_front();
+
+		if(!task->take(slice)) {
+			//stopped early by an unreadable slice
+			continue;
+		}
+		if(task->taken < task->count) {
+			//to the back: a long range does not hold up the others
+			pool->queue.push_back(task);
+		}
+		task->running++;
+		::pthread_mutex_unlock(&pool->lock);
+
+		computeSlice(task->memory, &slice);
+
+		::pthread_mutex_lock(&pool->lock);
+		task->running--;
+		task->put(slice);
+
+		if(task->isDone()) {
+			//under the lock: the task, and its session, cannot go away meanwhile
+			wakeup(task->eventfd);
+		}
+		if(task->running == 0) {
+			::pthread_cond_broadcast(&pool->idle);
+		}
+	}
+	return NULL;
+}
+
+size_t
+Crc32::Pool::size() const
+{
+	return threads;
+}
+
+void
+Crc32::Pool::submit(Task* task)
+{
+	::pthread_mutex_lock(&lock);
+	queue.push_back(task);
+	::pthread_cond_broadcast(&ready);
+	::pthread_mutex_unlock(&lock);
+}
+
+void
+Crc32::Pool::cancel(Task* task)
+{
+	::pthread_mutex_lock(&lock);
+
+	for(deque<Task*>::iterator it = queue.begin(); it != queue.end(); ) {
+		if(*it == task) {
+			it = queue.erase(it);
+		} else {
+			++it;
+		}
+	}
+	while(task->running > 0) {
+		::pthread_cond_wait(&idle, &lock);
+	}
+	::pthread_mutex_unlock(&lock);
+}
+
+bool
+Crc32::Pool::isDone(Task* task)
+{
+	::pthread_mutex_lock(&lock);
+
+	bool done = task->isDone();
+
+	::pthread_mutex_unlock(&lock);
+	return done;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//	class Crc32::Task
+//
+
+Crc32::Task::Task(Memory* memory, uint64_t addr, uint64_t len, uint32_t crc, int eventfd)
+{
+	Pool* pool = Pool::getInstance();
+
+	this->memory  = memory;
+	this->addr    = addr;
+	this->len     = len;
+	this->crc     = crc;
+	this->eventfd = eventfd;
+	count         = len / CRC_SLICE_SIZE + (len % CRC_SLICE_SIZE != 0);
+	taken         = 0;
+	folded        = 0;
+	valid         = true;
+	running       = 0;
+
+	if(count == 0) {
+		//an empty range is one empty slice
+		count = 1;
+	}
+
+	//a single slice is computed by poll() rather than wait for a thread
+	shared = pool->size() > 0 && count > 1;
+
+	if(shared) {
+		pool->submit(this);
+	}
+}
+
+Crc32::Task::~Task()
+{
+	if(shared) {
+		Pool::getInstance()->cancel(this);
+	}
+}
+
+bool
+Crc32::Task::take(Slice& slice)
+{
+	if(taken >= count) {
+		return false;
+	}
+	slice.index = taken;
+	slice.addr  = addr + taken * CRC_SLICE_SIZE;
+	slice.len   = (taken + 1 < count)? CRC_SLICE_SIZE: len - taken * CRC_SLICE_SIZE;
+	slice.crc   = (taken == 0)? crc: 0;	//the others are combined onto it
+	slice.valid = false;
+
+	taken++;
+	return true;
+}
+
+void
+Crc32::Task::put(const Slice& slice)
+{
+	if(!slice.valid) {
+		//the whole range fails: hand out no more
+		valid = false;
+		taken = count;
+		return;
+	}
+	if(slice.index != folded) {
+		early[slice.index] = slice;
+		return;
+	}
+	crc = (folded == 0)? slice.crc: combine(crc, slice.crc, slice.len);
+	folded++;
+
+	for(map<uint64_t, Slice>::iterator it = early.find(folded); it != early.end(); it = early.find(folded)) {
+		crc = combine(crc, it->second.crc, it->second.len);
+		folded++;
+		early.erase(it);
+	}
+}
+
+bool
+Crc32::Task::isDone() const
+{
+	return running == 0 && (!valid || folded == count);
+}
+
+bool
+Crc32::Task::poll()
+{
+	if(shared) {
+		return Pool::getInstance()->isDone(this);
+	}
+
+	Slice slice;
+
+	if(take(slice)) {
+		computeSlice(memory, &slice);
+		put(slice);
+	}
+	if(!isDone()) {
+		//the next slice on the next turn
+		wakeup(eventfd);
+		return false;
+	}
+	return true;
+}
+
+bool
+Crc32::Task::getResult(uint32_t& crc) const
+{
+	crc = this->crc;
+	return valid;
+}
+
+}; //namespace gdb
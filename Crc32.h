@@ -0,0 +1,87 @@
+#ifndef __Crc32__h__
+#define __Crc32__h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+
+#include "Memory.h"
+
+//the share of a qCRC range computed at once: by a pool thread, or on the
+//session loop between the events of the other sessions
+#define CRC_SLICE_SIZE		(16ULL << 20)
+
+namespace gdb {
+
+	//gdb's CRC-32 for qCRC: polynomial 0x04c11db7, MSB first, no final xor
+	class Crc32
+	{
+		class Pool;	//the threads computing the slices of every Task
+
+	public:
+		struct Slice
+		{
+			uint64_t index;
+			uint64_t addr;
+			uint64_t len;
+			uint32_t crc;
+			bool     valid;	//false if part of it cannot be read
+		};
+
+		//the crc of a memory range, computed a slice at a time while the
+		//caller goes on: by the pool threads, taking turns with the other
+		//tasks, or by poll() when there is no pool thread or a single slice
+		class Task
+		{
+			friend class Crc32::Pool;
+
+			Memory*                memory;
+			uint64_t               addr;
+			uint64_t               len;
+			uint64_t               count;	//slices
+			uint64_t               taken;	//slices handed out
+			uint64_t               folded;	//slices in crc, in order
+			uint32_t               crc;
+			bool                   valid;
+			map<uint64_t, Slice>   early;	//done ahead of the next to fold
+			int                    running;	//slices being computed by the pool
+			bool                   shared;	//given to the pool
+			int                    eventfd;	//written whenever poll() has more to do
+
+			//the next slice to compute, false if none is left
+			bool
+			take(Slice& slice);
+
+			//a computed slice, folded into crc once those before it are
+			void
+			put(const Slice& slice);
+
+			bool
+			isDone() const;
+
+		public:
+			Task(Memory* memory, uint64_t addr, uint64_t len, uint32_t crc, int eventfd);
+
+			//takes the task back from the pool, waits for the slices it is computing
+			~Task();
+
+			//true once every slice is done
+			bool
+			poll();
+
+			//false if part of the range cannot be read
+			bool
+			getResult(uint32_t& crc) const;
+		};
+
+		static uint32_t
+		update(uint32_t crc, const void* buf, size_t len);
+
+		//crc of A followed by B, from crc(A) and the crc of B started at 0
+		static uint32_t
+		combine(uint32_t crc, uint32_t next, uint64_t len);
+	};
+
+}; //namespace gdb
+
+#endif/*__Crc32__h__*/
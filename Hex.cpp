@@ -0,0 +1,222 @@
+#include "Hex.h"
+#include "Simd.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define HEX_X86	1
+#endif
+
+namespace gdb {
+
+#define _	-1
+const signed char Hex::values[256] = {
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, _, _, _, _, _, _,
+	_,10,11,12,13,14,15, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_,10,11,12,13,14,15, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _,
+	_, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _
+};
+#undef _
+
+const char Hex::digits[16] = {
+	'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+namespace {
+
+//both digits of every byte value, so a byte is encoded with a single load
+struct PairTable
+{
+	uint16_t pairs[256];
+
+	PairTable()
+	{
+		for(int i = 0; i < 256; i++) {
+			char pair[2] = {Hex::digits[i >> 4], Hex::digits[i & 0xf]};
+			::memcpy(&pairs[i], pair, 2);
+		}
+	}
+};
+
+const PairTable table;
+
+size_t
+encodeScalar(char* out, const unsigned char* in, size_t len)
+{
+	for(size_t i = 0; i < len; i++) {
+		::memcpy(out + 2 * i, &table.pairs[in[i]], 2);
+	}
+	return 2 * len;
+}
+
+ssize_t
+decodeScalar(unsigned char* out, const char* in, size_t len)
+{
+	for(size_t i = 0; i + 1 < len; i += 2) {
+		int hi = Hex::values[in[i]     & 0xff];
+		int lo = Hex::values[in[i + 1] & 0xff];
+
+		if((hi | lo) < 0) {
+			return -1;
+		}
+		*out++ = (hi << 4) | lo;
+	}
+	return len / 2;
+}
+
+#if HEX_X86
+
+__attribute__((target("ssse3"))) size_t
+encodeSSSE3(char* out, const unsigned char* in, size_t len)
+{
+	const __m128i lut  = _mm_loadu_si128((const __m128i*) Hex::digits);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t        i    = 0;
+
+	for(; i + 16 <= len; i += 16) {
+		__m128i v  = _mm_loadu_si128((const __m128i*) (in + i));
+		__m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		__m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+
+		_mm_storeu_si128((__m128i*) (out + 2 * i),      _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*) (out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return 2 * i + encodeScalar(out + 2 * i, in + i, len - i);
+}
+
+//hex digit values of 16 chars; invalid chars make the mask non-zero
+__attribute__((target("ssse3"))) inline __m128i
+valuesSSSE3(__m128i c, int& invalid)
+{
+	__m128i d       = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	__m128i a       = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)), _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(a, _mm_set1_epi8(-1)), _mm_cmplt_epi8(a, _mm_set1_epi8(6)));
+
+	invalid |= ~_mm_movemask_epi8(_mm_or_si128(digit, alpha)) & 0xffff;
+
+	return _mm_or_si128(_mm_and_si128(digit, d), _mm_and_si128(alpha, _mm_add_epi8(a, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3"))) ssize_t
+decodeSSSE3(unsigned char* out, const char* in, size_t len)
+{
+	//pairs of digit values (hi, lo) are merged into hi * 16 + lo
+	const __m128i weights = _mm_set1_epi16(0x0110);
+	size_t        i       = 0;
+	int           invalid = 0;
+
+	for(; i + 32 <= len; i += 32) {
+		__m128i v0 = valuesSSSE3(_mm_loadu_si128((const __m128i*) (in + i)),      invalid);
+		__m128i v1 = valuesSSSE3(_mm_loadu_si128((const __m128i*) (in + i + 16)), invalid);
+
+		_mm_storeu_si128((__m128i*) (out + i / 2),
+			_mm_packus_epi16(_mm_maddubs_epi16(v0, weights), _mm_maddubs_epi16(v1, weights)));
+	}
+	if(invalid || decodeScalar(out + i / 2, in + i, len - i) < 0) {
+		return -1;
+	}
+	return len / 2;
+}
+
+__attribute__((target("avx2"))) size_t
+encodeAVX2(char* out, const unsigned char* in, size_t len)
+{
+	const __m256i lut  = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) Hex::digits));
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	size_t        i    = 0;
+
+	for(; i + 32 <= len; i += 32) {
+		__m256i v  = _mm256_loadu_si256((const __m256i*) (in + i));
+		__m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+		__m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+		__m256i l  = _mm256_unpacklo_epi8(hi, lo);	//bytes 0-7, 16-23
+		__m256i h  = _mm256_unpackhi_epi8(hi, lo);	//bytes 8-15, 24-31
+
+		_mm256_storeu_si256((__m256i*) (out + 2 * i),      _mm256_permute2x128_si256(l, h, 0x20));
+		_mm256_storeu_si256((__m256i*) (out + 2 * i + 32), _mm256_permute2x128_si256(l, h, 0x31));
+	}
+	return 2 * i + encodeSSSE3(out + 2 * i, in + i, len - i);
+}
+
+__attribute__((target("avx2"))) inline __m256i
+valuesAVX2(__m256i c, unsigned& invalid)
+{
+	__m256i d       = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+	__m256i a       = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(d, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(10), d));
+	__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(a, _mm256_set1_epi8(-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(6), a));
+
+	invalid |= ~(unsigned) _mm256_movemask_epi8(_mm256_or_si256(digit, alpha));
+
+	return _mm256_or_si256(_mm256_and_si256(digit, d), _mm256_and_si256(alpha, _mm256_add_epi8(a, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2"))) ssize_t
+decodeAVX2(unsigned char* out, const char* in, size_t len)
+{
+	const __m256i weights = _mm256_set1_epi16(0x0110);
+	size_t        i       = 0;
+	unsigned      invalid = 0;
+
+	for(; i + 64 <= len; i += 64) {
+		__m256i v0 = valuesAVX2(_mm256_loadu_si256((const __m256i*) (in + i)),      invalid);
+		__m256i v1 = valuesAVX2(_mm256_loadu_si256((const __m256i*) (in + i + 32)), invalid);
+		__m256i p  = _mm256_packus_epi16(_mm256_maddubs_epi16(v0, weights), _mm256_maddubs_epi16(v1, weights));
+
+		//packus works per 128-bit lane; restore the byte order
+		_mm256_storeu_si256((__m256i*) (out + i / 2), _mm256_permute4x64_epi64(p, 0xd8));
+	}
+	if(invalid || decodeSSSE3(out + i / 2, in + i, len - i) < 0) {
+		return -1;
+	}
+	return len / 2;
+}
+
+#endif/*HEX_X86*/
+
+};
+
+size_t
+Hex::encode(char* out, const void* in, size_t len)
+{
+	switch(Simd::getLevel()) {
+#if HEX_X86
+		case Simd::AVX2:
+			return encodeAVX2(out, (const unsigned char*) in, len);
+		case Simd::SSSE3:
+			return encodeSSSE3(out, (const unsigned char*) in, len);
+#endif
+	}
+	return encodeScalar(out, (const unsigned char*) in, len);
+}
+
+ssize_t
+Hex::decode(void* out, const char* in, size_t len)
+{
+	switch(Simd::getLevel()) {
+#if HEX_X86
+		case Simd::AVX2:
+			return decodeAVX2((unsigned char*) out, in, len);
+		case Simd::SSSE3:
+			return decodeSSSE3((unsigned char*) out, in, len);
+#endif
+	}
+	return decodeScalar((unsigned char*) out, in, len);
+}
+
+}; //namespace gdb
@@ -0,0 +1,29 @@
+#ifndef __Hex__h__
+#define __Hex__h__
+
+#include <stddef.h>
+#include <sys/types.h>
+
+namespace gdb {
+
+	//hex codecs for memory and register traffic; SIMD where the CPU has it
+	class Hex
+	{
+	public:
+		//value of a hex digit, -1 for anything else
+		static const signed char values[256];
+
+		static const char digits[16];
+
+		//writes 2 * len lowercase hex digits to out, returns their number
+		static size_t
+		encode(char* out, const void* in, size_t len);
+
+		//decodes len hex digits (len / 2 bytes) to out, -1 on a non-hex char
+		static ssize_t
+		decode(void* out, const char* in, size_t len);
+	};
+
+}; //namespace gdb
+
+#endif/*__Hex__h__*/
@@ -0,0 +1,13 @@
+#include "Job.h"
+
+namespace gdb {
+
+Job::Job()
+{
+}
+
+Job::~Job()
+{
+}
+
+}; //namespace gdb
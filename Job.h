@@ -0,0 +1,29 @@
+#ifndef __Job__h__
+#define __Job__h__
+
+namespace gdb {
+
+	class RSP;
+
+	//a reply that takes longer to work out than the session loop may stop for,
+	//such as qCRC of a whole section: handed to RSP::defer(), it is continued
+	//between the events of the other sessions, and the session takes no other
+	//packet until the reply is out
+	class Job
+	{
+	public:
+		Job();
+
+		virtual
+		~Job();
+
+		//takes the next turn: true once the reply is sent; false to be called
+		//again after the session's poller is woken, by RSP::wake() or by
+		//whoever finishes the work
+		virtual bool
+		run(RSP* rsp) = 0;
+	};
+
+}; //namespace gdb
+
+#endif/*__Job__h__*/
@@ -0,0 +1,603 @@
+#include "Debug.h"
+#include "Memory.h"
+#include "Simd.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+
+#define PAGE_SHIFT		(12)
+#define PAGE_SIZE		(1UL << PAGE_SHIFT)
+#define PAGE_MASK		(PAGE_SIZE - 1)
+
+//4 levels of 13 bits cover the 52-bit page number of a 64-bit address
+#define RADIX_BITS		(13)
+#define RADIX_SIZE		(1UL << RADIX_BITS)
+#define RADIX_MASK		(RADIX_SIZE - 1)
+#define RADIX_LEVELS		(4)
+
+#define SEARCH_CHUNK		(1UL << 20)
+
+namespace gdb {
+
+//sparse memory: pages are allocated on the first write of non-zero data;
+//everything never written reads from one shared zero page
+class PagedMemory: public Memory
+{
+	struct Node
+	{
+		void* slots[RADIX_SIZE];
+	};
+
+	static const char zeroPage[PAGE_SIZE];
+
+	Node*            root;
+	pthread_rwlock_t lock;
+
+	char*
+	lookup(uint64_t page) const;
+
+	char*
+	allocate(uint64_t page);
+
+	void
+	release(Node* node, int level);
+
+public:
+	PagedMemory();
+
+	virtual
+	~PagedMemory();
+
+	virtual size_t
+	read(uint64_t addr, void* buf, size_t len);
+
+	virtual size_t
+	write(uint64_t addr, const void* buf, size_t len);
+};
+
+//a file mapped into the address space: an ELF core dump or a raw image;
+//pages are faulted in only when gdb reads them
+class MappedMemory: public Memory
+{
+	struct Segment
+	{
+		uint64_t addr;
+		uint64_t size;		//backed by the file
+		char*    data;
+
+		bool
+		operator<(const Segment& other) const
+		{
+			return addr < other.addr;
+		}
+	};
+
+	char*            map;
+	size_t           map_size;
+	vector<Segment>  segments;
+	string           regs;
+	const char*      arch;
+	pthread_rwlock_t lock;	//'M' from one session against reads from the others
+
+	template<typename Ehdr, typename Phdr, typename Nhdr>
+	bool
+	parse();
+
+	void
+	parseNotes(int machine, const char* ptr, size_t size);
+
+	const Segment*
+	find(uint64_t addr) const;
+
+	void
+	close();
+
+public:
+	MappedMemory(const string& params, bool elf);
+
+	virtual
+	~MappedMemory();
+
+	//false if the file could not be opened, mapped or parsed
+	bool
+	isMapped() const;
+
+	virtual size_t
+	read(uint64_t addr, void* buf, size_t len);
+
+	virtual size_t
+	write(uint64_t addr, const void* buf, size_t len);
+
+	virtual bool
+	getRegisters(string_view& regs);
+
+	virtual const char*
+	getArchitecture();
+};
+
+//////////////////////////////////////////////////////////////////
+//
+//	class Memory
+//
+
+Memory*
+Memory::createInstance(const string& name, const string& params)
+{
+	if(name == "paged") {
+		return new PagedMemory();
+	}
+	if(name == "core" || name == "image") {
+		MappedMemory* memory = new MappedMemory(params, name == "core");
+
+		if(!memory->isMapped()) {
+			//the reason is logged
+			delete memory;
+			return NULL;
+		}
+		return memory;
+	}
+	return NULL;
+}
+
+Memory::Memory()
+{
+}
+
+Memory::~Memory()
+{
+}
+
+bool
+Memory::getRegisters(string_view& regs)
+{
+	return false;
+}
+
+const char*
+Memory::getArchitecture()
+{
+	return NULL;
+}
+
+int
+Memory::search(uint64_t addr, uint64_t len, const void* pattern, size_t pattern_len, uint64_t& found)
+{
+	if(pattern_len == 0 || pattern_len > len) {
+		return 0;
+	}
+
+	//chunks overlap by pattern_len - 1 so a match across a boundary is seen
+	vector<char> buf(SEARCH_CHUNK + pattern_len - 1);
+
+	for(uint64_t off = 0; off + pattern_len <= len; off += SEARCH_CHUNK) {
+		size_t want = (size_t) min<uint64_t>(buf.size(), len - off);
+		size_t got  = read(addr + off, &buf[0], want);
+		size_t pos  = Simd::find(&buf[0], got, pattern, pattern_len);
+
+		if(pos < got) {
+			found = addr + off + pos;
+			return 1;
+		}
+		if(got < want) {
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//	class PagedMemory
+//
+
+const char PagedMemory::zeroPage[PAGE_SIZE] = {0};
+
+PagedMemory::PagedMemory()
+{
+	root = new Node();
+	::pthread_rwlock_init(&lock, NULL);
+}
+
+PagedMemory::~PagedMemory()
+{
+	release(root, 0);
+	::pthread_rwlock_destroy(&lock);
+}
+
+void
+PagedMemory::release(Node* node, int level)
+{
+	for(size_t i = 0; i < RADIX_SIZE; i++) {
+		if(node->slots[i] == NULL) {
+			continue;
+		}
+		if(level + 1 < RADIX_LEVELS) {
+			release((Node*) node->slots[i], level + 1);
+		} else {
+			delete[] (char*) node->slots[i];
+		}
+	}
+	delete node;
+}
+
+char*
+PagedMemory::lookup(uint64_t page) const
+{
+	Node* node = root;
+
+	for(int level = 0; level < RADIX_LEVELS - 1; level++) {
+		node = (Node*) node->slots[(page >> ((RADIX_LEVELS - 1 - level) * RADIX_BITS)) & RADIX_MASK];
+
+		if(node == NULL) {
+			return NULL;
+		}
+	}
+	return (char*) node->slots[page & RADIX_MASK];
+}
+
+char*
+PagedMemory::allocate(uint64_t page)
+{
+	Node* node = root;
+
+	for(int level = 0; level < RADIX_LEVELS - 1; level++) {
+		void*& slot = node->slots[(page >> ((RADIX_LEVELS - 1 - level) * RADIX_BITS)) & RADIX_MASK];
+
+		if(slot == NULL) {
+			slot = new Node();
+		}
+		node = (Node*) slot;
+	}
+
+	void*& slot = node->slots[page & RADIX_MASK];
+
+	if(slot == NULL) {
+		//copy-on-write of the zero page
+		slot = new char[PAGE_SIZE];
+		::memset(slot, 0, PAGE_SIZE);
+	}
+	return (char*) slot;
+}
+
+size_t
+PagedMemory::read(uint64_t addr, void* buf, size_t len)
+{
+	char*  out   = (char*) buf;
+	size_t total = 0;
+
+	if(len > ~addr) {
+		//do not wrap around the end of the address space
+		len = ~addr + 1;
+	}
+
+	::pthread_rwlock_rdlock(&lock);
+
+	while(total < len) {
+		size_t      offset = (addr + total) & PAGE_MASK;
+		size_t      n      = PAGE_SIZE - offset;
+		const char* page   = lookup((addr + total) >> PAGE_SHIFT);
+
+		if(n > len - total) {
+			n = len - total;
+		}
+		::memcpy(out + total, (page? page: zeroPage) + offset, n);
+		total += n;
+	}
+
+	::pthread_rwlock_unlock(&lock);
+	return total;
+}
+
+size_t
+PagedMemory::write(uint64_t addr, const void* buf, size_t len)
+{
+	const char* in    = (const char*) buf;
+	size_t      total = 0;
+
+	if(len > ~addr) {
+		len = ~addr + 1;
+	}
+
+	::pthread_rwlock_wrlock(&lock);
+
+	while(total < len) {
+		uint64_t page   = (addr + total) >> PAGE_SHIFT;
+		size_t   offset = (addr + total) & PAGE_MASK;
+		size_t   n      = PAGE_SIZE - offset;
+		char*    ptr    = lookup(page);
+
+		if(n > len - total) {
+			n = len - total;
+		}
+		if(ptr == NULL) {
+			//zeros written to the zero page leave it shared
+			if(::memcmp(in + total, zeroPage, n) == 0) {
+				total += n;
+				continue;
+			}
+			ptr = allocate(page);
+		}
+		::memcpy(ptr + offset, in + total, n);
+		total += n;
+	}
+
+	::pthread_rwlock_unlock(&lock);
+	return total;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//	class MappedMemory
+//
+
+//params: path of the core file, or path[@load address] of a raw image
+MappedMemory::MappedMemory(const string& params, bool elf)
+{
+	string      path = params;
+	uint64_t    base = 0;
+	int         fd   = -1;
+	struct stat st;
+
+	map      = NULL;
+	map_size = 0;
+	arch     = NULL;
+	::pthread_rwlock_init(&lock, NULL);
+
+	if(!elf) {
+		size_t at = params.rfind('@');
+
+		if(at != string::npos) {
+			path = params.substr(0, at);
+			base = ::strtoull(params.c_str() + at + 1, NULL, 0);
+		}
+	}
+
+	if((fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC)) < 0) {
+		LOG("%s: %m", path.c_str());
+		return;
+	}
+	if(::fstat(fd, &st) < 0 || st.st_size == 0) {
+		LOG("%s: cannot map an empty file", path.c_str());
+		::close(fd);
+		return;
+	}
+
+	//private and writable: 'M' patches the stub's copy, shared by every session, never the file
+	map_size = st.st_size;
+	map      = (char*) ::mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if(map == MAP_FAILED) {
+		LOG("%s: mmap error: %m", path.c_str());
+		map = NULL;
+		return;
+	}
+
+	if(!elf) {
+		Segment segment = {base, map_size, map};
+		segments.push_back(segment);
+		return;
+	}
+
+	bool valid = false;
+
+	if(map_size >= EI_NIDENT && ::memcmp(map, ELFMAG, SELFMAG) == 0) {
+		switch(map[EI_CLASS]) {
+			case ELFCLASS64:
+				valid = parse<Elf64_Ehdr, Elf64_Phdr, Elf64_Nhdr>();
+				break;
+			case ELFCLASS32:
+				valid = parse<Elf32_Ehdr, Elf32_Phdr, Elf32_Nhdr>();
+				break;
+		}
+	}
+	if(!valid) {
+		LOG("%s: not an ELF core file", path.c_str());
+		close();
+		return;
+	}
+	std::sort(segments.begin(), segments.end());
+}
+
+MappedMemory::~MappedMemory()
+{
+	close();
+	::pthread_rwlock_destroy(&lock);
+}
+
+bool
+MappedMemory::isMapped() const
+{
+	return map != NULL;
+}
+
+void
+MappedMemory::close()
+{
+	if(map) {
+		::munmap(map, map_size);
+		map = NULL;
+	}
+	segments.clear();
+}
+
+template<typename Ehdr, typename Phdr, typename Nhdr>
+bool
+MappedMemory::parse()
+{
+	const Ehdr* ehdr = (const Ehdr*) map;
+
+	if(map_size < sizeof(Ehdr) || ehdr->e_type != ET_CORE || ehdr->e_phentsize != sizeof(Phdr)) {
+		return false;
+	}
+	if(ehdr->e_phoff > map_size || ehdr->e_phnum > (map_size - ehdr->e_phoff) / sizeof(Phdr)) {
+		return false;
+	}
+
+	const Phdr* phdr = (const Phdr*) (map + ehdr->e_phoff);
+
+	for(int i = 0; i < ehdr->e_phnum; i++, phdr++) {
+		if(phdr->p_offset > map_size || phdr->p_filesz > map_size - phdr->p_offset) {
+			//truncated core
+			continue;
+		}
+		if(phdr->p_type == PT_LOAD && phdr->p_filesz > 0) {
+			//bytes beyond p_filesz were not dumped and stay unreadable
+			Segment segment = {phdr->p_vaddr, phdr->p_filesz, map + phdr->p_offset};
+			segments.push_back(segment);
+			continue;
+		}
+		if(phdr->p_type == PT_NOTE && regs.empty()) {
+			parseNotes(ehdr->e_machine, map + phdr->p_offset, phdr->p_filesz);
+		}
+	}
+	return true;
+}
+
+void
+MappedMemory::parseNotes(int machine, const char* ptr, size_t size)
+{
+	//pr_reg inside struct elf_prstatus, and the user_regs_struct slots in gdb's 'g' order
+	static const int amd64_regs[] = {10, 5, 11, 12, 13, 14, 4, 19, 9, 8, 7, 6, 3, 2, 1, 0, 16};
+	static const int amd64_segs[] = {18, 17, 20, 23, 24, 25, 26};	//eflags, cs, ss, ds, es, fs, gs
+	static const int i386_regs[]  = {6, 1, 2, 0, 15, 5, 3, 4, 12, 14, 13, 16, 7, 8, 9, 10};
+
+	const char* limit = ptr + size;
+
+	while(ptr + sizeof(Elf32_Nhdr) <= limit) {
+		const Elf32_Nhdr* nhdr = (const Elf32_Nhdr*) ptr;	//same layout in ELF64
+		const char*       desc = ptr + sizeof(Elf32_Nhdr) + ((nhdr->n_namesz + 3) & ~3);
+
+		ptr = desc + ((nhdr->n_descsz + 3) & ~3);
+
+		if(ptr > limit || nhdr->n_type != NT_PRSTATUS) {
+			continue;
+		}
+
+		//the first NT_PRSTATUS is the thread that took the signal
+		if(machine == EM_X86_64 && nhdr->n_descsz >= 112 + 27 * 8) {
+			const uint64_t* reg = (const uint64_t*) (desc + 112);
+
+			for(size_t i = 0; i < sizeof(amd64_regs) / sizeof(amd64_regs[0]); i++) {
+				regs.append((const char*) &reg[amd64_regs[i]], 8);
+			}
+			for(size_t i = 0; i < sizeof(amd64_segs) / sizeof(amd64_segs[0]); i++) {
+				regs.append((const char*) &reg[amd64_segs[i]], 4);
+			}
+			arch = "i386:x86-64";
+			return;
+		}
+		if(machine == EM_386 && nhdr->n_descsz >= 72 + 17 * 4) {
+			const uint32_t* reg = (const uint32_t*) (desc + 72);
+
+			for(size_t i = 0; i < sizeof(i386_regs) / sizeof(i386_regs[0]); i++) {
+				regs.append((const char*) &reg[i386_regs[i]], 4);
+			}
+			arch = "i386";
+			return;
+		}
+	}
+}
+
+const MappedMemory::Segment*
+MappedMemory::find(uint64_t addr) const
+{
+	//the last segment starting at or below addr
+	Segment key = {addr, 0, NULL};
+
+	vector<Segment>::const_iterator it = std::upper_bound(segments.begin(), segments.end(), key);
+
+	if(it == segments.begin()) {
+		return NULL;
+	}
+	--it;
+
+	if(addr - it->addr >= it->size) {
+		return NULL;
+	}
+	return &*it;
+}
+
+size_t
+MappedMemory::read(uint64_t addr, void* buf, size_t len)
+{
+	char*  out   = (char*) buf;
+	size_t total = 0;
+
+	::pthread_rwlock_rdlock(&lock);
+
+	while(total < len) {
+		const Segment* segment = find(addr + total);
+
+		if(segment == NULL) {
+			break;
+		}
+
+		uint64_t offset = addr + total - segment->addr;
+		size_t   n      = segment->size - offset;
+
+		if(n > len - total) {
+			n = len - total;
+		}
+		::memcpy(out + total, segment->data + offset, n);
+		total += n;
+	}
+
+	::pthread_rwlock_unlock(&lock);
+	return total;
+}
+
+size_t
+MappedMemory::write(uint64_t addr, const void* buf, size_t len)
+{
+	const char* in    = (const char*) buf;
+	size_t      total = 0;
+
+	::pthread_rwlock_wrlock(&lock);
+
+	while(total < len) {
+		const Segment* segment = find(addr + total);
+
+		if(segment == NULL) {
+			break;
+		}
+
+		uint64_t offset = addr + total - segment->addr;
+		size_t   n      = segment->size - offset;
+
+		if(n > len - total) {
+			n = len - total;
+		}
+		::memcpy(segment->data + offset, in + total, n);
+		total += n;
+	}
+
+	::pthread_rwlock_unlock(&lock);
+	return total;
+}
+
+bool
+MappedMemory::getRegisters(string_view& regs)
+{
+	if(this->regs.empty()) {
+		return false;
+	}
+	regs = this->regs;
+	return true;
+}
+
+const char*
+MappedMemory::getArchitecture()
+{
+	return arch;
+}
+
+}; //end of namespace gdb
@@ -0,0 +1,54 @@
+#ifndef __Memory__h__
+#define __Memory__h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+//the part of a qSearch range scanned per turn of the session loop
+#define SEARCH_SLICE_SIZE	(16ULL << 20)
+
+namespace gdb
+{
+	//target memory as seen by 'm', 'M' and 'X', addressed with 64 bits
+	class Memory
+	{
+	protected:
+		Memory();
+
+	public:
+		//NULL for an unknown name or a file that cannot be served
+		static Memory*
+		createInstance(const string& name, const string& params);
+
+		virtual
+		~Memory();
+
+		//returns the number of bytes copied; stops at the first unreadable byte
+		virtual size_t
+		read(uint64_t addr, void* buf, size_t len) = 0;
+
+		//returns the number of bytes stored; stops at the first unwritable byte
+		virtual size_t
+		write(uint64_t addr, const void* buf, size_t len) = 0;
+
+		//raw register block in gdb's 'g' order, for backends that carry one;
+		//the view stays valid as long as the backend
+		virtual bool
+		getRegisters(string_view& regs);
+
+		//gdb architecture name, NULL if the backend does not know
+		virtual const char*
+		getArchitecture();
+
+		//first occurrence of pattern in [addr, addr + len): 1 and its address
+		//in found, 0 if there is none, -1 if an unreadable byte comes first
+		int
+		search(uint64_t addr, uint64_t len, const void* pattern, size_t pattern_len, uint64_t& found);
+	};
+};
+
+#endif/*__Memory__h__*/
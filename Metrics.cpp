@@ -0,0 +1,276 @@
+#include "Debug.h"
+#include "Metrics.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <map>
+
+namespace gdb {
+
+//every Metrics alive, for report()
+static pthread_mutex_t   registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static vector<Metrics*>  registry;
+
+Counter::Counter()
+{
+	value.store(0, memory_order_relaxed);
+}
+
+uint64_t
+Histogram::highest(int bucket)
+{
+	if(bucket < HISTOGRAM_SUB) {
+		return bucket;
+	}
+
+	int      bits   = bucket / HISTOGRAM_SUB + HISTOGRAM_SUB_BITS - 1;
+	uint64_t lowest = (uint64_t) (HISTOGRAM_SUB + bucket % HISTOGRAM_SUB) << (bits - HISTOGRAM_SUB_BITS);
+
+	return lowest + (1ULL << (bits - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void
+Histogram::collect(vector<uint64_t>& counts, uint64_t& sum, uint64_t& max) const
+{
+	counts.resize(HISTOGRAM_BUCKETS);
+
+	for(int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		counts[i] += this->counts[i].get();
+	}
+	sum += this->sum.get();
+
+	if(this->max.get() > max) {
+		max = this->max.get();
+	}
+}
+
+uint64_t
+Histogram::quantile(const vector<uint64_t>& counts, double q)
+{
+	uint64_t total = 0;
+
+	for(size_t i = 0; i < counts.size(); i++) {
+		total += counts[i];
+	}
+
+	uint64_t rank = (uint64_t) (q * total);
+	uint64_t seen = 0;
+
+	for(size_t i = 0; i < counts.size(); i++) {
+		seen += counts[i];
+
+		if(seen > rank) {
+			return highest(i);
+		}
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////
+Metrics::Metrics()
+{
+	pthread_mutex_lock(&registry_lock);
+	registry.push_back(this);
+	pthread_mutex_unlock(&registry_lock);
+}
+
+Metrics::~Metrics()
+{
+	pthread_mutex_lock(&registry_lock);
+
+	for(size_t i = 0; i < registry.size(); i++) {
+		if(registry[i] == this) {
+			registry.erase(registry.begin() + i);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	for(size_t i = 0; i < commands.size(); i++) {
+		delete commands[i];
+	}
+}
+
+int
+Metrics::define(const string& name, const string& handler)
+{
+	Command* command = new Command;
+
+	command->name    = name;
+	command->handler = handler;
+
+	//report() may walk the table while the worker starts up
+	pthread_mutex_lock(&registry_lock);
+	commands.push_back(command);
+	pthread_mutex_unlock(&registry_lock);
+	return commands.size() - 1;
+}
+
+void
+Metrics::recordErrors(uint64_t naks, uint64_t retransmits)
+{
+	this->naks.add(naks);
+	this->retransmits.add(retransmits);
+}
+
+uint64_t
+Metrics::now()
+{
+	struct timespec ts;
+	::clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct Summary
+{
+	uint64_t         count;
+	uint64_t         bytesIn;
+	uint64_t         bytesOut;
+	vector<uint64_t> latency;
+	uint64_t         sum;
+	uint64_t         max;
+
+	Summary(): count(0), bytesIn(0), bytesOut(0), sum(0), max(0)
+	{
+	}
+};
+
+static string
+duration(uint64_t ns)
+{
+	char buf[32];
+
+	if(ns < 1000) {
+		snprintf(buf, sizeof(buf), "%lluns", (unsigned long long) ns);
+	} else if(ns < 1000000) {
+		snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+	} else if(ns < 1000000000) {
+		snprintf(buf, sizeof(buf), "%.1fms", ns / 1e6);
+	} else {
+		snprintf(buf, sizeof(buf), "%.1fs", ns / 1e9);
+	}
+	return buf;
+}
+
+//quantiles are bucket upper ends; none is above the largest sample
+static uint64_t
+quantile(const Summary& summary, double q)
+{
+	uint64_t value = Histogram::quantile(summary.latency, q);
+
+	return value < summary.max? value: summary.max;
+}
+
+static void
+print(string& out, const string& name, const Summary& summary)
+{
+	char line[256];
+
+	snprintf(line, sizeof(line), "%-24s %10llu %12llu %12llu %8s %8s %8s %8s %8s\n",
+		name.c_str(),
+		(unsigned long long) summary.count,
+		(unsigned long long) summary.bytesIn,
+		(unsigned long long) summary.bytesOut,
+		duration(summary.count? summary.sum / summary.count: 0).c_str(),
+		duration(quantile(summary, 0.5)).c_str(),
+		duration(quantile(summary, 0.99)).c_str(),
+		duration(quantile(summary, 0.999)).c_str(),
+		duration(summary.max).c_str());
+	out += line;
+}
+
+static void
+add(Summary& summary, uint64_t count, uint64_t bytesIn, uint64_t bytesOut, const Histogram& latency)
+{
+	summary.count    += count;
+	summary.bytesIn  += bytesIn;
+	summary.bytesOut += bytesOut;
+	latency.collect(summary.latency, summary.sum, summary.max);
+}
+
+string
+Metrics::report()
+{
+	map<string, Summary> commands;
+	map<string, Summary> handlers;
+	uint64_t             naks        = 0;
+	uint64_t             retransmits = 0;
+	string               out;
+	char                 line[256];
+
+	pthread_mutex_lock(&registry_lock);
+
+	for(size_t i = 0; i < registry.size(); i++) {
+		Metrics* metrics = registry[i];
+
+		for(size_t j = 0; j < metrics->commands.size(); j++) {
+			Command* c     = metrics->commands[j];
+			uint64_t count = c->count.get();
+
+			if(count == 0) {
+				continue;
+			}
+			add(commands[c->name], count, c->bytesIn.get(), c->bytesOut.get(), c->latency);
+			add(handlers[c->handler], count, c->bytesIn.get(), c->bytesOut.get(), c->latency);
+		}
+		naks        += metrics->naks.get();
+		retransmits += metrics->retransmits.get();
+	}
+	pthread_mutex_unlock(&registry_lock);
+
+	snprintf(line, sizeof(line), "%-24s %10s %12s %12s %8s %8s %8s %8s %8s\n",
+		"command", "count", "bytes in", "bytes out", "mean", "p50", "p99", "p99.9", "max");
+	out += line;
+
+	for(map<string, Summary>::const_iterator it = commands.begin(); it != commands.end(); it++) {
+		print(out, it->first, it->second);
+	}
+
+	snprintf(line, sizeof(line), "%-24s\n", "handler");
+	out += line;
+
+	for(map<string, Summary>::const_iterator it = handlers.begin(); it != handlers.end(); it++) {
+		print(out, it->first, it->second);
+	}
+
+	snprintf(line, sizeof(line), "naks sent %llu, packets retransmitted %llu\n", (unsigned long long) naks, (unsigned long long) retransmits);
+	out += line;
+	return out;
+}
+
+static void*
+dumper(void* arg)
+{
+	unsigned interval = (unsigned) (uintptr_t) arg;
+
+	while(true) {
+		::sleep(interval);
+
+		string text = Metrics::report();
+
+		fprintf(stderr, "%s", text.c_str());
+		fflush(stderr);
+	}
+	return NULL;
+}
+
+bool
+Metrics::dump(unsigned interval)
+{
+	pthread_t thread;
+
+	if(interval == 0) {
+		return false;
+	}
+	if(pthread_create(&thread, NULL, dumper, (void*) (uintptr_t) interval) != 0) {
+		LOG("pthread_create error");
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+}; //namespace gdb
@@ -0,0 +1,150 @@
+#ifndef __Metrics__h__
+#define __Metrics__h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//log-linear buckets: 16 per power of two (6% wide) up to 2^40 ns (18 minutes)
+#define HISTOGRAM_SUB_BITS	(4)
+#define HISTOGRAM_SUB		(1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_MAX_BITS	(40)
+#define HISTOGRAM_BUCKETS	((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 2) * HISTOGRAM_SUB)
+
+namespace gdb {
+
+	//written by one thread, read by any: relaxed loads and stores, no locked
+	//read-modify-write on the hot path
+	class Counter
+	{
+		atomic<uint64_t> value;
+
+	public:
+		Counter();
+
+		void
+		add(uint64_t n)
+		{
+			value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed);
+		}
+
+		void
+		set(uint64_t n)
+		{
+			value.store(n, memory_order_relaxed);
+		}
+
+		uint64_t
+		get() const
+		{
+			return value.load(memory_order_relaxed);
+		}
+	};
+
+	//HDR-style latency histogram in ns
+	class Histogram
+	{
+		Counter counts[HISTOGRAM_BUCKETS];
+		Counter sum;
+		Counter max;
+
+		static int
+		bucket(uint64_t value)
+		{
+			if(value < HISTOGRAM_SUB) {
+				return value;
+			}
+			if(value >> HISTOGRAM_MAX_BITS) {
+				value = (1ULL << HISTOGRAM_MAX_BITS) - 1;
+			}
+
+			int bits = 63 - __builtin_clzll(value);
+
+			return (bits - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB + ((value >> (bits - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+		}
+
+	public:
+		void
+		record(uint64_t value)
+		{
+			counts[bucket(value)].add(1);
+			sum.add(value);
+
+			if(value > max.get()) {
+				max.set(value);
+			}
+		}
+
+		//upper end of a bucket
+		static uint64_t
+		highest(int bucket);
+
+		//adds the samples to plain copies of counts, sum and max
+		void
+		collect(vector<uint64_t>& counts, uint64_t& sum, uint64_t& max) const;
+
+		//value at quantile q of collected counts, rounded up to its bucket
+		static uint64_t
+		quantile(const vector<uint64_t>& counts, double q);
+	};
+
+	//counters of the commands dispatched by one Processor, which is one
+	//worker thread; report() sums all of them
+	class Metrics
+	{
+		struct Command
+		{
+			string    name;
+			string    handler;
+			Counter   count;
+			Counter   bytesIn;
+			Counter   bytesOut;
+			Histogram latency;	//packet taken from the receive buffer to reply sent
+		};
+
+		vector<Command*> commands;
+		Counter          naks;
+		Counter          retransmits;
+
+	public:
+		Metrics();
+
+		~Metrics();
+
+		//returns the index to record() samples of the command under
+		int
+		define(const string& name, const string& handler);
+
+		void
+		record(int command, uint64_t latency, size_t in, size_t out)
+		{
+			Command* c = commands[command];
+
+			c->count.add(1);
+			c->bytesIn.add(in);
+			c->bytesOut.add(out);
+			c->latency.record(latency);
+		}
+
+		void
+		recordErrors(uint64_t naks, uint64_t retransmits);
+
+		//a table of every command and handler seen by any Processor
+		static string
+		report();
+
+		//writes report() to stderr every interval seconds
+		static bool
+		dump(unsigned interval);
+
+		static uint64_t
+		now();
+	};
+
+}; //namespace gdb
+
+#endif/*__Metrics__h__*/
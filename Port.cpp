@@ -2,14 +2,19 @@
 #include "Port.h"
 
 #include <stdio.h>
+#include <stddef.h>
 #include <malloc.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
 
 #define GDB_DEFAULT_TCP_PORT	(1234)
 
@@ -23,13 +28,37 @@ class TcpPort: public Port
 	close();
 
 public:
-	TcpPort(const string& params);
+	TcpPort(const string& params, int flags);
 
 	virtual
 	~TcpPort();
 
 	virtual Socket*
 	accept();
+
+	virtual int
+	getFd() const;
+};
+
+class UnixPort: public Port
+{
+	int    sd;
+	string path;	//to unlink on close, empty for an abstract address
+
+	void
+	close();
+
+public:
+	UnixPort(const string& params);
+
+	virtual
+	~UnixPort();
+
+	virtual Socket*
+	accept();
+
+	virtual int
+	getFd() const;
 };
 
 class StdioPort: public Port
@@ -49,11 +78,25 @@ public:
 //	class Port
 //
 
+//a listener that failed to set up, having logged why, is of no use
+static Port*
+listening(Port* port)
+{
+	if(port->getFd() < 0) {
+		delete port;
+		return NULL;
+	}
+	return port;
+}
+
 Port*
-Port::createInstance(const string& name, const string& params)
+Port::createInstance(const string& name, const string& params, int flags)
 {
 	if(name == "tcp") {
-		return new TcpPort(params);
+		return listening(new TcpPort(params, flags));
+	}
+	if(name == "unix") {
+		return listening(new UnixPort(params));
 	}
 	if(name == "stdio") {
 		return new StdioPort();
@@ -69,12 +112,19 @@ Port::~Port()
 {
 }
 
+int
+Port::getFd() const
+{
+	//no listening descriptor; accept() hands out a single session
+	return -1;
+}
+
 //////////////////////////////////////////////////////////////////
 //
 //	class TcpPort
 //
 
-TcpPort::TcpPort(const string& params)
+TcpPort::TcpPort(const string& params, int flags)
 {
 	int                port = ::atoi(params.c_str());
 	int                n    = 1;
@@ -93,6 +143,14 @@ TcpPort::TcpPort(const string& params)
 	::fcntl(sd, F_SETFD, FD_CLOEXEC);
 	::setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, &n, sizeof(n));
 
+	if(flags & REUSEPORT) {
+		//the kernel spreads incoming connections over all listeners on the port
+		if(::setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &n, sizeof(n)) < 0) {
+			LOG("setsockopt(SO_REUSEPORT) error: %m");
+			goto failure;
+		}
+	}
+
 	::memset(&addr, 0, sizeof(addr));
 	addr.sin_family      = AF_INET;
 	addr.sin_port        = htons(port);
@@ -102,7 +160,10 @@ TcpPort::TcpPort(const string& params)
 		LOG("bind error: %m");
 		goto failure;
 	}
-	if(::listen(sd, 1) < 0) {
+	//accept() is driven by the event loop, never block in it
+	::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	if(::listen(sd, SOMAXCONN) < 0) {
 		LOG("listen error: %m\n");
 		goto failure;
 	}
@@ -131,17 +192,132 @@ TcpPort::accept()
 {
 	struct sockaddr_in addr;
 	socklen_t          n      = sizeof(addr);
-	int                client = ::accept(sd, (struct sockaddr*) &addr, (socklen_t*) &n);
+	int                one    = 1;
+	int                client = ::accept4(sd, (struct sockaddr*) &addr, (socklen_t*) &n, SOCK_CLOEXEC | SOCK_NONBLOCK);
 
 	if(client < 0) {
-		LOG("accept error: %m");
+		int error = errno;
+
+		if(error != EAGAIN && error != EWOULDBLOCK && error != EINTR) {
+			LOG("accept error: %m");
+		}
+		errno = error;	//for the caller, EMFILE in particular
 		return NULL;
 	}
-	::fcntl(n, F_SETFD, FD_CLOEXEC);
+
+	//replies are whole frames, written at once: never wait for an ack of
+	//the previous segment before sending them
+	::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
 
 	return Socket::createInstance("tcp", client);
 }
 
+int
+TcpPort::getFd() const
+{
+	return sd;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//	class UnixPort
+//
+
+//params is a filesystem path, or "@name" for the abstract namespace
+UnixPort::UnixPort(const string& params)
+{
+	struct sockaddr_un addr;
+	struct stat        st;
+	socklen_t          n = sizeof(addr);
+
+	::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if(params.empty() || params.length() >= sizeof(addr.sun_path)) {
+		LOG("bad unix socket address: %s", params.c_str());
+		sd = -1;
+		return;
+	}
+	::memcpy(addr.sun_path, params.data(), params.length());
+
+	if(params[0] == '@') {
+		//abstract: no file, gone with the socket
+		addr.sun_path[0] = '\0';
+		n = offsetof(struct sockaddr_un, sun_path) + params.length();
+	} else {
+		path = params;
+
+		//a socket left behind by a stub that was killed
+		if(::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+			::unlink(path.c_str());
+		}
+	}
+
+	sd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if(sd < 0) {
+		LOG("socket error: %m");
+		goto failure;
+	}
+	if(::bind(sd, (struct sockaddr*) &addr, n) < 0) {
+		LOG("bind error: %m");
+		path.clear();
+		goto failure;
+	}
+	//accept() is driven by the event loop, never block in it
+	::fcntl(sd, F_SETFL, ::fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+	if(::listen(sd, SOMAXCONN) < 0) {
+		LOG("listen error: %m\n");
+		goto failure;
+	}
+	return;
+
+failure:
+	close();
+}
+
+UnixPort::~UnixPort()
+{
+	close();
+}
+
+void
+UnixPort::close()
+{
+	if(sd >= 0) {
+		::close(sd);
+		sd = -1;
+	}
+	if(!path.empty()) {
+		::unlink(path.c_str());
+		path.clear();
+	}
+}
+
+Socket*
+UnixPort::accept()
+{
+	int client = ::accept4(sd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+	if(client < 0) {
+		int error = errno;
+
+		if(error != EAGAIN && error != EWOULDBLOCK && error != EINTR) {
+			LOG("accept error: %m");
+		}
+		errno = error;	//for the caller, EMFILE in particular
+		return NULL;
+	}
+	return Socket::createInstance("unix", client);
+}
+
+int
+UnixPort::getFd() const
+{
+	return sd;
+}
+
 //////////////////////////////////////////////////////////////////
 //
 //	class StdioPort
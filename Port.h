@@ -15,14 +15,23 @@ namespace gdb
 		Port();
 
 	public:
+		enum {
+			REUSEPORT = 1	//share the address with other listeners (SO_REUSEPORT)
+		};
+
+		//NULL for an unknown name or a listener that cannot be set up
 		static Port*
-		createInstance(const string& name, const string& params);
+		createInstance(const string& name, const string& params, int flags = 0);
 
 		virtual
 		~Port();
 
+		//NULL with errno set when no connection is taken
 		virtual Socket*
 		accept() = 0;
+
+		virtual int
+		getFd() const;
 	};
 };
 
@@ -1,6 +1,85 @@
+#include "Debug.h"
 #include "Processor.h"
+#include "ResponseBuilder.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <cxxabi.h>
+#include <vector>
+
+#define PROCESSOR_MAX_EVENTS	(64)
+#define PROCESSOR_MAX_MATCHES	(8)
+
+//tag the epoll data of a session's stop eventfd, and of its output
+//descriptor where that is not the socket's; sessions are aligned
+#define PROCESSOR_STOP_EVENT	(1)
+#define PROCESSOR_OUTPUT_EVENT	(2)
+#define PROCESSOR_TAGS		(PROCESSOR_STOP_EVENT | PROCESSOR_OUTPUT_EVENT)
+
+//out of descriptors, accepting is tried again after a session closes or this long
+#define PROCESSOR_ACCEPT_RETRY	(1000)	//ms
+
+#define MPOL_BIND		(2)	//<numaif.h>, without depending on libnuma
+
+namespace {
+
+struct Worker
+{
+	gdb::Processor* processor;
+	pthread_t       thread;
+	string          name;
+	string          params;
+	int             cpu;
+	int             node;
+	bool            ok;		//its listener was set up
+};
+
+//parse a sysfs cpu list such as "0-3,8-11"
+bool
+parseCpuList(const char* path, cpu_set_t& cpus)
+{
+	FILE* fp = fopen(path, "r");
+
+	if(fp == NULL) {
+		return false;
+	}
+
+	CPU_ZERO(&cpus);
+
+	int  first = 0;
+	int  last  = 0;
+	char sep   = 0;
+
+	while(fscanf(fp, "%d", &first) == 1) {
+		last = first;
+
+		if((sep = fgetc(fp)) == '-') {
+			if(fscanf(fp, "%d", &last) != 1) {
+				break;
+			}
+			sep = fgetc(fp);
+		}
+		for(; first <= last; first++) {
+			CPU_SET(first, &cpus);
+		}
+		if(sep != ',') {
+			break;
+		}
+	}
+	fclose(fp);
+	return CPU_COUNT(&cpus) > 0;
+}
+
+};
 
 namespace gdb {
 
@@ -13,6 +92,26 @@ Handler::~Handler()
 {
 }
 
+bool
+Handler::onPacket(RSP* rsp, string_view cmd, string_view param)
+{
+	return onHandle(rsp, string(cmd), string(param));
+}
+
+bool
+Handler::onHandle(RSP* rsp, const string& cmd, const string& param)
+{
+	return false;
+}
+
+bool
+Handler::onStop(RSP* rsp, int signal)
+{
+	rsp->setRunning(false);
+
+	return ResponseBuilder(rsp).append('S').appendInt(signal, 16, 2).finish() >= 0;
+}
+
 //////////////////////////////////////////////////////
 Processor::Response::Response()
 {
@@ -26,10 +125,18 @@ Processor::Response::~Response()
 //////////////////////////////////////////////////////
 Processor::Processor()
 {
+	epfd       = -1;
+	metrics    = NULL;
+	packetSize = RSP_DEFAULT_BUFFER_SIZE;
+	traceSize  = TRACE_DEFAULT_SIZE;
 }
 
 Processor::~Processor()
 {
+	if(metrics) {
+		delete metrics;
+		metrics = NULL;
+	}
 }
 
 void
@@ -41,7 +148,9 @@ Processor::defineResponseV(const string& cmd, const string& message, va_list arg
 
 	if(buf) {
 		responseMap[cmd].message = buf;
+		responseMap[cmd].frame   = RSP::frame(buf, ::strlen(buf));
 		responseMap[cmd].handler = NULL;
+		free(buf);
 	}
 }
 
@@ -59,122 +168,605 @@ Processor::defineResponse(const string& cmd, Handler* handler)
 {
 	responseMap[cmd].handler = handler;
 	responseMap[cmd].message = "";
+	responseMap[cmd].frame   = "";
+}
+
+void
+Processor::setPacketSize(size_t packetSize)
+{
+	this->packetSize = packetSize;
+}
+
+void
+Processor::setTrace(const string& dir, size_t size)
+{
+	traceDir  = dir;
+	traceSize = size;
+}
+
+//the class name of a handler, for the metrics
+static string
+handlerName(Handler* handler)
+{
+	if(handler == NULL) {
+		return "(static)";
+	}
+
+	int    status = 0;
+	char*  name   = abi::__cxa_demangle(typeid(*handler).name(), NULL, NULL, &status);
+	string result = name? name: typeid(*handler).name();
+
+	free(name);
+	return result;
+}
+
+void
+Processor::compile()
+{
+	commands.clear();
+	responses.clear();
+
+	//a worker copies the Processor before it runs, the metrics are its own
+	metrics = new Metrics();
+
+	for(ResponseMap::const_iterator response = responseMap.begin(); response != responseMap.end(); ++response) {
+		commands.insert(response->first, responses.size());
+		responses.push_back(&response->second);
+		metrics->define(response->first, handlerName(response->second.handler));
+	}
+	metrics->define("(unknown)", "(empty reply)");
+	commands.compile();
+}
+
+bool
+Processor::dispatch(Session* session, const char* buf, int n, uint64_t start)
+{
+	RSP*     rsp  = session->getRSP();
+	uint64_t sent = rsp->getBytesSent();
+	bool     ok   = false;
+	int      used = responses.size();
+
+	//payloads such as 'X' carry binary data, never rely on NUL termination
+	CommandTrie::Match matches[PROCESSOR_MAX_MATCHES];
+	int                count = commands.match(buf, n, matches, PROCESSOR_MAX_MATCHES);
+
+	//longest command first; a handler may decline and leave it to a shorter one
+	for(int i = 0; i < count; i++) {
+		const Response* response = responses[matches[i].value];
+
+		if(response->handler == NULL) {
+			ok   = rsp->sendFrame(response->frame.data(), response->frame.length()) >= 0;
+			used = matches[i].value;
+			goto leave;
+		}
+
+		string_view cmd(buf, matches[i].cmd_len);
+		string_view param(buf + matches[i].param, n - matches[i].param);
+
+		if(response->handler->onPacket(rsp, cmd, param)) {
+			if(rsp->isRunning() && session->getResumed() == NULL) {
+				//no reply until the target stops
+				session->setResumed(response->handler);
+			}
+			ok   = true;
+			used = matches[i].value;
+			goto leave;
+		}
+	}
+
+	//reply with empty packet
+	ok = rsp->sendPacket("") >= 0;
+
+leave:
+	metrics->record(used, Metrics::now() - start, rsp->getFrameSize(), rsp->getBytesSent() - sent);
+
+	uint64_t naks        = 0;
+	uint64_t retransmits = 0;
+
+	//NAKs and retransmits up to this packet
+	rsp->takeErrors(naks, retransmits);
+
+	if(naks > 0 || retransmits > 0) {
+		metrics->recordErrors(naks, retransmits);
+	}
+	return ok;
+}
+
+bool
+Processor::process(Session* session)
+{
+	RSP* rsp = session->getRSP();
+
+	if(!rsp->isBlocking()) {
+		int n = rsp->fill();
+
+		if(n <= 0 && n != RSP::AGAIN) {
+			if(session->getOutputFd() != session->getFd() && (rsp->getJob() || rsp->isCongested())) {
+				//stdin ended but stdout still takes what is owed: stop watching
+				//stdin, the end is read again once that is out
+				::epoll_ctl(epfd, EPOLL_CTL_DEL, session->getFd(), NULL);
+				return true;
+			}
+			//disconnected
+			return false;
+		}
+	}
+	return handle(session);
 }
 
 bool
-Processor::getNextToken(const char* buf, const char* &sep, string& cmd, string& param) const
+Processor::handle(Session* session)
 {
-	static const char delimiters[] = ":;,";
+	RSP*        rsp = session->getRSP();
+	const char* buf = NULL;
+
+	if(!rsp->isBlocking()) {
+		//the replies to what one read brought in leave together
+		rsp->beginBatch();
+	}
 
-	if(sep == NULL) {
+	while(true) {
+		if(rsp->isCongested()) {
+			//gdb does not read its replies: take no more packets from it
+			//until the socket has taken them
+			rsp->endBatch();
+			return watch(session, EPOLLOUT);
+		}
+		if(rsp->getJob()) {
+			//the reply to the last packet is still being worked out,
+			//the next ones wait for it
+			if(rsp->isBlocking()) {
+				if(!finish(session)) {
+					return false;
+				}
+				continue;
+			}
+			rsp->endBatch();
+			return watch(session, 0);
+		}
+
+		uint64_t start = Metrics::now();
+
+		//buf points into the receive buffer, valid until the next packet
+		int n = rsp->receivePacket(buf);
+
+		if(n < 0) {
+			if(n == RSP::AGAIN) {
+				//wait for the next readable event
+				rsp->endBatch();
+				return true;
+			}
+			if(n == RSP::INTERRUPTED) {
+				//Ctrl-C from gdb
+				if(rsp->isNonStop()) {
+					if(rsp->queueStop(SIGINT) < 0) {
+						return false;
+					}
+				} else if(rsp->isRunning() && !stop(session, SIGINT)) {
+					return false;
+				}
+				continue;
+			}
+			return false;
+		}
+
+		if(n == 0) {
+			//empty command
+			continue;
+		}
+
+		if(!dispatch(session, buf, n, start)) {
+			return false;
+		}
+	}
+}
+
+bool
+Processor::resume(Session* session)
+{
+	int n = session->getRSP()->drain();
+
+	if(n != 0) {
+		//still waiting for the socket, or disconnected
+		return n > 0;
+	}
+	return watch(session, EPOLLIN) && handle(session);
+}
+
+//sets what the loop waits for on a registered descriptor, registering it if it is not
+static bool
+control(int epfd, int fd, uint64_t data, uint32_t events)
+{
+	struct epoll_event ev;
+
+	ev.events   = events;
+	ev.data.u64 = data;
+
+	if(::epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0 && (errno != ENOENT || ::epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+		LOG("epoll_ctl error: %m");
 		return false;
 	}
-	if(sep <= buf) {
-		sep = NULL;
+	return true;
+}
+
+bool
+Processor::watch(Session* session, uint32_t events)
+{
+	int in  = session->getFd();
+	int out = session->getOutputFd();
+
+	if(out == in) {
+		return control(epfd, in, (uintptr_t) session, events);
+	}
+
+	//stdio: the packets come in on stdin, the replies leave on stdout
+	if(!control(epfd, in, (uintptr_t) session, events & ~EPOLLOUT)) {
 		return false;
 	}
+	if(events & EPOLLOUT) {
+		return control(epfd, out, (uintptr_t) session | PROCESSOR_OUTPUT_EVENT, EPOLLOUT);
+	}
+	//not registered, or a regular file that never needs to be waited for
+	if(::epoll_ctl(epfd, EPOLL_CTL_DEL, out, NULL) < 0 && errno != ENOENT && errno != EPERM) {
+		LOG("epoll_ctl error: %m");
+		return false;
+	}
+	return true;
+}
 
-	int digits = 0;
+bool
+Processor::proceed(Session* session)
+{
+	RSP* rsp = session->getRSP();
+	Job* job = rsp->getJob();
+
+	if(job == NULL || !job->run(rsp)) {
+		//nothing deferred, or woken again for the next turn
+		return true;
+	}
+	rsp->endJob();
+	return watch(session, EPOLLIN) && handle(session);
+}
 
-	for(--sep; sep >= buf; sep--) {
-		if(strchr(delimiters, *sep) != NULL) {
-			cmd.assign(buf, sep - buf);
-			param.assign(sep + 1);
-			return true;
+bool
+Processor::finish(Session* session)
+{
+	RSP* rsp = session->getRSP();
+
+	while(!rsp->getJob()->run(rsp)) {
+		struct pollfd pfd;
+
+		pfd.fd     = rsp->getEventFd();
+		pfd.events = POLLIN;
+
+		if(::poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+			LOG("poll error: %m");
+			return false;
+		}
+		//takes the wakeup, and any stop that came with it
+		if(!drainStops(session)) {
+			return false;
 		}
-		if(*sep == '-' || (*sep >= '0' && *sep <= '9')) {
-			digits++;
+	}
+	rsp->endJob();
+	return true;
+}
+
+bool
+Processor::stop(Session* session, int signal)
+{
+	Handler* handler = session->getResumed();
+
+	session->setResumed(NULL);
+
+	if(handler == NULL) {
+		session->getRSP()->setRunning(false);
+		return true;
+	}
+	return handler->onStop(session->getRSP(), signal);
+}
+
+bool
+Processor::drainStops(Session* session)
+{
+	RSP*     rsp    = session->getRSP();
+	int      signal = 0;
+	uint64_t thread = 0;
+
+	while(rsp->takeStop(signal, thread)) {
+		if(rsp->isNonStop()) {
+			//each thread stops on its own and is reported on its own
+			if(rsp->queueStop(signal, thread) < 0) {
+				return false;
+			}
 			continue;
 		}
-		if(digits > 0) {
-			sep++;
-			cmd.assign(buf, sep - buf);
-			param.assign(sep);
-			return true;
+		//all-stop: the first stop halts the whole target
+		if(rsp->isRunning() && !stop(session, signal)) {
+			return false;
 		}
 	}
-	cmd.assign(buf);
-	param = "";
+	return true;
+}
+
+bool
+Processor::open(Session* session)
+{
+	struct epoll_event ev;
+
+	ev.events   = EPOLLIN;
+	ev.data.ptr = session;
+
+	session->getRSP()->setBlocking(false);
+
+	if(!traceDir.empty()) {
+		session->getRSP()->setTrace(Trace::createInstance(traceDir, traceSize));
+	}
+
+	if(::epoll_ctl(epfd, EPOLL_CTL_ADD, session->getFd(), &ev) < 0) {
+		if(errno == EPERM) {
+			//not pollable, e.g. a regular file on stdin: serve it in place
+			session->getRSP()->setBlocking(true);
+			process(session);
+		} else {
+			LOG("epoll_ctl error: %m");
+		}
+		delete session;
+		return false;
+	}
+
+	ev.events   = EPOLLIN;
+	ev.data.u64 = (uintptr_t) session | PROCESSOR_STOP_EVENT;
+
+	if(::epoll_ctl(epfd, EPOLL_CTL_ADD, session->getRSP()->getEventFd(), &ev) < 0) {
+		LOG("epoll_ctl error: %m");
+		::epoll_ctl(epfd, EPOLL_CTL_DEL, session->getFd(), NULL);
+		delete session;
+		return false;
+	}
+	sessions.insert(session);
 	return true;
 }
 
 void
+Processor::close(Session* session)
+{
+	::epoll_ctl(epfd, EPOLL_CTL_DEL, session->getFd(), NULL);
+	::epoll_ctl(epfd, EPOLL_CTL_DEL, session->getRSP()->getEventFd(), NULL);
+
+	if(session->getOutputFd() != session->getFd()) {
+		::epoll_ctl(epfd, EPOLL_CTL_DEL, session->getOutputFd(), NULL);
+	}
+
+	sessions.erase(session);
+
+	//later events of the same batch may still point to it
+	closed.insert(session);
+}
+
+void
+Processor::reap()
+{
+	for(SessionSet::iterator it = closed.begin(); it != closed.end(); ++it) {
+		delete *it;
+	}
+	closed.clear();
+}
+
+bool
 Processor::serve(const string& name, const string& params)
 {
-	Port*   port = NULL;
-	Socket* s    = NULL;
-	RSP*    rsp  = NULL;
+	Port* port = Port::createInstance(name, params);
 
-	if((port = Port::createInstance(name, params)) == NULL) {
-		goto leave;
+	if(port == NULL) {
+		return false;
 	}
-	if((s = port->accept()) == NULL) {
-		goto leave;
+	run(port);
+	delete port;
+	return true;
+}
+
+bool
+Processor::serve(const string& name, const string& params, int workers, int node)
+{
+	if(workers <= 1 || name != "tcp") {
+		return serve(name, params);
+	}
+
+	//CPUs to spread the workers over: those of the NUMA node, or all we may run on
+	cpu_set_t allowed;
+	cpu_set_t cpus;
+
+	CPU_ZERO(&allowed);
+	::sched_getaffinity(0, sizeof(allowed), &allowed);
+
+	if(node >= 0) {
+		char path[64];
+
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+
+		if(!parseCpuList(path, cpus)) {
+			LOG("unknown NUMA node %d", node);
+			return false;
+		}
+		CPU_AND(&cpus, &cpus, &allowed);
+	} else {
+		cpus = allowed;
+	}
+
+	vector<int> cpulist;
+
+	for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if(CPU_ISSET(cpu, &cpus)) {
+			cpulist.push_back(cpu);
+		}
+	}
+	if(cpulist.empty()) {
+		LOG("no CPU available for the workers");
+		return false;
+	}
+
+	vector<Worker> pool(workers);
+
+	for(int i = 0; i < workers; i++) {
+		Worker& w = pool[i];
+
+		//each worker dispatches through its own copy of the response table
+		w.processor = new Processor(*this);
+		w.name      = name;
+		w.params    = params;
+		w.cpu       = cpulist[i % cpulist.size()];
+		w.node      = node;
+		w.ok        = false;
+
+		if(::pthread_create(&w.thread, NULL, worker, &w) != 0) {
+			LOG("pthread_create error: %m");
+			delete w.processor;
+			w.processor = NULL;
+		}
+	}
+
+	bool ok = true;
+
+	for(int i = 0; i < workers; i++) {
+		if(pool[i].processor) {
+			::pthread_join(pool[i].thread, NULL);
+			delete pool[i].processor;
+		}
+		ok = ok && pool[i].ok;
+	}
+	return ok;
+}
+
+void*
+Processor::worker(void* arg)
+{
+	Worker*   w = (Worker*) arg;
+	cpu_set_t cpus;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(w->cpu, &cpus);
+
+	if(::pthread_setaffinity_np(::pthread_self(), sizeof(cpus), &cpus) != 0) {
+		LOG("cannot pin worker to cpu %d", w->cpu);
+	}
+	if(w->node >= 0) {
+		unsigned long nodemask[16] = {0};
+
+		nodemask[w->node / (8 * sizeof(long))] |= 1UL << (w->node % (8 * sizeof(long)));
+
+		if(::syscall(SYS_set_mempolicy, MPOL_BIND, nodemask, 8 * sizeof(nodemask)) < 0) {
+			LOG("set_mempolicy error: %m");
+		}
 	}
-	rsp = new RSP(s);
 
-	if(rsp == NULL) {
+	//every worker owns a listener; connections are balanced by the kernel
+	Port* port = Port::createInstance(w->name, w->params, Port::REUSEPORT);
+
+	if(port) {
+		w->ok = true;
+		w->processor->run(port);
+		delete port;
+	}
+	return NULL;
+}
+
+void
+Processor::run(Port* port)
+{
+	int  listenfd = -1;
+	bool paused   = false;	//out of descriptors: the listener is not watched
+
+	compile();
+
+	if((epfd = ::epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		LOG("epoll_create error: %m");
 		goto leave;
 	}
 
-nextPacket:
-	{
-		char        buf[RSP_DEFAULT_BUFFER_SIZE];
-		int         n     = rsp->receivePacket(buf, sizeof(buf));
-		const char* sep   = buf + n;
-		string      cmd   = "";
-		string      param = "";
+	if((listenfd = port->getFd()) >= 0) {
+		struct epoll_event ev;
 
-		if(n < 0) {
-			if(n == RSP::INTERRUPTED) {
-				goto nextPacket;
-			}
+		ev.events   = EPOLLIN;
+		ev.data.ptr = NULL;
+
+		if(::epoll_ctl(epfd, EPOLL_CTL_ADD, listenfd, &ev) < 0) {
+			LOG("epoll_ctl error: %m");
 			goto leave;
 		}
+	} else {
+		//a port without a listening descriptor hands out a single session
+		Socket* s = port->accept();
 
-		if(n == 0) {
-			//empty command
-			goto nextPacket;
+		if(s) {
+			open(new Session(s, packetSize));
 		}
+	}
 
+	while(listenfd >= 0 || !sessions.empty()) {
+		struct epoll_event events[PROCESSOR_MAX_EVENTS];
+		int                n = ::epoll_wait(epfd, events, PROCESSOR_MAX_EVENTS, paused? PROCESSOR_ACCEPT_RETRY: -1);
 
-		while(sep) {
-			if(!getNextToken(buf, sep, cmd, param)) {
-				cmd.assign(buf, 1);
-				param.assign(buf + 1);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
 			}
+			LOG("epoll_wait error: %m");
+			break;
+		}
 
-			ResponseMap::const_iterator response = responseMap.find(cmd);
+		for(int i = 0; i < n; i++) {
+			Session* session = (Session*) (events[i].data.u64 & ~(uint64_t) PROCESSOR_TAGS);
 
-			if(response != responseMap.end()) {
-				if(response->second.handler == NULL) {
-					if(rsp->sendPacket(response->second.message.c_str(), response->second.message.length()) < 0) {
-						goto leave;
-					}
-					goto nextPacket;
+			if(session == NULL) {
+				Socket* s;
+
+				while((s = port->accept()) != NULL) {
+					open(new Session(s, packetSize));
+				}
+				if(errno == EMFILE || errno == ENFILE) {
+					//the connection stays pending and the listener readable:
+					//leave it until a session closes or the retry delay is over
+					paused = control(epfd, listenfd, 0, 0);
+				}
+				continue;
+			}
+			if(closed.count(session)) {
+				continue;
+			}
+			if(events[i].data.u64 & PROCESSOR_STOP_EVENT) {
+				if(!drainStops(session) || !proceed(session)) {
+					close(session);
+				} else if(session->getRSP()->isCongested() && !watch(session, EPOLLOUT)) {
+					//a stop or deferred reply the socket did not take
+					close(session);
 				}
-				if(response->second.handler->onHandle(rsp, cmd, param)) {
-					goto nextPacket;
+				continue;
+			}
+			if((events[i].data.u64 & PROCESSOR_OUTPUT_EVENT) || (events[i].events & EPOLLOUT)) {
+				if(!resume(session)) {
+					close(session);
 				}
+				continue;
+			}
+			if(!process(session)) {
+				close(session);
 			}
 		}
-
-		//reply with empty packet
-		if(rsp->sendPacket("") < 0) {
-			goto leave;
+		if(paused && (n == 0 || !closed.empty())) {
+			paused = !control(epfd, listenfd, 0, EPOLLIN);
 		}
-		goto nextPacket;
+		reap();
 	}
 
 leave:
-	if(rsp) {
-		delete rsp;
-	}
-	if(s) {
-		delete s;
+	while(!sessions.empty()) {
+		close(*sessions.begin());
 	}
-	if(port) {
-		delete port;
+	reap();
+	if(epfd >= 0) {
+		::close(epfd);
+		epfd = -1;
 	}
 }
 
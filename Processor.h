@@ -3,7 +3,12 @@
 
 #include <string>
 #include <map>
+#include <set>
+#include <vector>
 #include "RSP.h"
+#include "Session.h"
+#include "CommandTrie.h"
+#include "Metrics.h"
 
 using namespace std;
 
@@ -17,8 +22,18 @@ namespace gdb {
 		virtual
 		~Handler();
 
+		//views into the received packet, valid until the handler returns;
+		//the default copies them for onHandle()
 		virtual bool
-		onHandle(RSP* rsp, const string& cmd, const string& param) = 0;
+		onPacket(RSP* rsp, string_view cmd, string_view param);
+
+		virtual bool
+		onHandle(RSP* rsp, const string& cmd, const string& param);
+
+		//the target resumed by this handler stopped: a 0x03 from gdb or
+		//RSP::notifyStop(); the default replies "Sxx" and clears running
+		virtual bool
+		onStop(RSP* rsp, int signal);
 	};
 
 	class Processor
@@ -27,6 +42,7 @@ namespace gdb {
 		{
 			Handler* handler;
 			string   message;
+			string   frame;		//message framed once, sent as is
 
 			Response();
 			~Response();
@@ -34,10 +50,72 @@ namespace gdb {
 
 		typedef map<string, Response> ResponseMap;
 
-		ResponseMap responseMap;
+		typedef set<Session*> SessionSet;
+
+		ResponseMap              responseMap;
+		CommandTrie              commands;	//compiled from responseMap by run()
+		vector<const Response*>  responses;	//indexed by the values in commands
+		Metrics*                 metrics;	//indexed as responses, then unknown commands
+		SessionSet               sessions;
+		SessionSet               closed;	//closed in this epoll batch, deleted after it
+		int                      epfd;
+		size_t                   packetSize;	//for the RSP of each new session
+		string                   traceDir;	//traces every new session there if set
+		size_t                   traceSize;
+
+		void
+		compile();
+
+		bool
+		open(Session* session);
+
+		void
+		close(Session* session);
+
+		//deletes the sessions closed since the last call
+		void
+		reap();
+
+		bool
+		process(Session* session);
+
+		//takes the packets received, until the socket has to be waited for
+		bool
+		handle(Session* session);
+
+		//the socket takes more of the replies kept for it
+		bool
+		resume(Session* session);
+
+		//what of the session's socket the loop waits for: EPOLLIN, EPOLLOUT,
+		//or 0 while a deferred reply is worked out
+		bool
+		watch(Session* session, uint32_t events);
+
+		//the next turn of the session's deferred reply; once it is out, the
+		//packets that waited for it
+		bool
+		proceed(Session* session);
+
+		//blocking sessions: the deferred reply, to the end
+		bool
+		finish(Session* session);
+
+		//start: when the packet was taken from the receive buffer
+		bool
+		dispatch(Session* session, const char* buf, int n, uint64_t start);
+
+		bool
+		stop(Session* session, int signal);
 
 		bool
-		getNextToken(const char* buf, const char* &sep, string& cmd, string& param) const;
+		drainStops(Session* session);
+
+		void
+		run(Port* port);
+
+		static void*
+		worker(void* arg);
 
 	public:
 		Processor();
@@ -54,7 +132,17 @@ namespace gdb {
 		defineResponse(const string& cmd, Handler* handler);
 
 		void
+		setPacketSize(size_t packetSize);
+
+		void
+		setTrace(const string& dir, size_t size = TRACE_DEFAULT_SIZE);
+
+		//false if the port cannot be set up
+		bool
 		serve(const string& name, const string& params = "");
+
+		bool
+		serve(const string& name, const string& params, int workers, int node = -1);
 	};
 
 }; //namespace gdb
@@ -1,408 +1,1178 @@
 #include "RSP.h"
+#include "Simd.h"
+#include "ResponseBuilder.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+//3 repeats cost as much as '*' and the count; 97 is the last printable count
+#define RLE_MIN_REPEAT		(3)
+#define RLE_MAX_REPEAT		(126 - 29)
 
 namespace gdb {
 
-RSP::Buffer::Buffer(Socket* s, size_t size)
+RSP::Buffer::Buffer(Socket* s, size_t size, size_t limit)
+{
+	this->s           = s;
+	this->len         = 0;
+	this->size        = size;
+	this->limit       = limit;
+	this->buf         = new char[size];
+	this->spare       = NULL;
+	this->spare_size  = 0;
+	this->pos         = 0;
+	this->blocking    = true;
+	this->pinned      = false;
+	this->trace       = NULL;
+	this->total       = 0;
+	this->pending_pos = 0;
+}
+
+RSP::Buffer::~Buffer()
+{
+	if(buf) {
+		delete[] buf;
+		buf = NULL;
+	}
+	if(spare) {
+		delete[] spare;
+		spare = NULL;
+	}
+}
+
+bool
+RSP::Buffer::grow()
+{
+	if(limit > 0 && size >= limit) {
+		return false;
+	}
+
+	size_t newsize = limit > 0 && size * 2 > limit? limit: size * 2;
+	char*  newbuf  = new char[newsize];
+
+	::memcpy(newbuf, buf, len);
+	delete[] buf;
+
+	buf  = newbuf;
+	size = newsize;
+	return true;
+}
+
+void
+RSP::Buffer::setLimit(size_t limit)
+{
+	this->limit = limit;
+}
+
+void
+RSP::Buffer::setTrace(Trace* trace)
+{
+	this->trace = trace;
+}
+
+uint64_t
+RSP::Buffer::getTotal() const
+{
+	return total;
+}
+
+void
+RSP::Buffer::setBlocking(bool blocking)
+{
+	this->blocking = blocking;
+}
+
+bool
+RSP::Buffer::isBlocking() const
+{
+	return blocking;
+}
+
+int
+RSP::Buffer::fill()
+{
+	if(pinned) {
+		if(pos >= len || len >= size) {
+			//buf still backs the last packet handed out; go on in the spare storage
+			size_t remaining = len - pos;
+
+			if(spare_size < size) {
+				//buf has grown since the spare was made
+				delete[] spare;
+				spare      = new char[size];
+				spare_size = size;
+			}
+			::memcpy(spare, buf + pos, remaining);
+
+			char*  tmp      = buf;
+			size_t tmp_size = size;
+
+			buf        = spare;
+			size       = spare_size;
+			spare      = tmp;
+			spare_size = tmp_size;
+			len        = remaining;
+			pos        = 0;
+			pinned     = false;
+		}
+	} else if(pos >= len) {
+		pos = len = 0;
+	} else if(pos > 0) {
+		::memmove(buf, buf + pos, len - pos);
+		len -= pos;
+		pos  = 0;
+	}
+	if(len >= size) {
+		return 0;
+	}
+
+	int n = s->read(buf + len, size - len);
+
+	if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return AGAIN;
+	}
+	if(n <= 0) {
+		return -1;
+	}
+	if(trace) {
+		trace->record(TRACE_IN, buf + len, n);
+	}
+	total += n;
+
+	len += n;
+	return n;
+}
+
+#undef putc
+
+int
+RSP::Buffer::putc(int ch)
+{
+	//a frame is never flushed half-way, it is kept whole for retransmission
+	if(len >= size && !grow()) {
+		return -1;
+	}
+	buf[len++] = ch;
+	return ch & 0xff;
+}
+
+int
+RSP::Buffer::write(const void* buffer, size_t length)
+{
+	while(len + length > size) {
+		if(!grow()) {
+			return -1;
+		}
+	}
+	::memcpy(buf + len, buffer, length);
+	len += length;
+	return length;
+}
+
+char*
+RSP::Buffer::append(size_t n)
+{
+	while(len + n > size) {
+		if(!grow()) {
+			return NULL;
+		}
+	}
+
+	char* ptr = buf + len;
+
+	len += n;
+	return ptr;
+}
+
+void
+RSP::Buffer::truncate(size_t n)
+{
+	len -= n;
+
+	if(pos > len) {
+		pos = len;
+	}
+}
+
+int
+RSP::Buffer::flush()
+{
+	struct iovec iov = {buf + pos, len - pos};
+	int          n   = sendv(&iov, 1);
+
+	if(n < 0) {
+		return -1;
+	}
+	pos = len;
+	return n;
+}
+
+void
+RSP::Buffer::clear()
+{
+	len = 0;
+	pos = 0;
+}
+
+int
+RSP::Buffer::resend(size_t offset)
+{
+	pos = offset;
+	return flush();
+}
+
+int
+RSP::Buffer::send(const void* buffer, size_t length)
+{
+	struct iovec iov = {(void*) buffer, length};
+
+	return sendv(&iov, 1);
+}
+
+int
+RSP::Buffer::sendv(struct iovec* iov, int iovcnt)
+{
+	int sent = 0;
+
+	while(true) {
+		//skip what has been written
+		for(; iovcnt > 0 && iov->iov_len == 0; iov++, iovcnt--) {
+		}
+		if(iovcnt == 0) {
+			return sent;
+		}
+
+		//behind output already kept, or the socket is full: keep the rest
+		int n = isCongested()? -1: s->writev(iov, iovcnt);
+
+		if(n < 0 && (isCongested() || errno == EAGAIN || errno == EWOULDBLOCK)) {
+			for(; iovcnt > 0; iov++, iovcnt--) {
+				pending.append((const char*) iov->iov_base, iov->iov_len);
+				sent += iov->iov_len;
+			}
+			return sent;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		if(trace) {
+			trace->record(TRACE_OUT, iov, iovcnt, n);
+		}
+		sent  += n;
+		total += n;
+
+		for(; n > 0; iov++, iovcnt--) {
+			size_t done = (size_t) n < iov->iov_len? n: iov->iov_len;
+
+			iov->iov_base  = (char*) iov->iov_base + done;
+			iov->iov_len  -= done;
+			n             -= done;
+
+			if(iov->iov_len > 0) {
+				break;
+			}
+		}
+	}
+}
+
+int
+RSP::Buffer::drain()
+{
+	while(isCongested()) {
+		int n = s->write(pending.data() + pending_pos, pending.length() - pending_pos);
+
+		if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return pending.length() - pending_pos;
+		}
+		if(n <= 0) {
+			return -1;
+		}
+		if(trace) {
+			trace->record(TRACE_OUT, pending.data() + pending_pos, n);
+		}
+		total       += n;
+		pending_pos += n;
+	}
+	pending.clear();
+	pending_pos = 0;
+	return 0;
+}
+
+bool
+RSP::Buffer::isCongested() const
+{
+	return pending_pos < pending.length();
+}
+
+void
+RSP::Buffer::discard(size_t n)
+{
+	if(n > len) {
+		n = len;
+	}
+	::memmove(buf, buf + n, len - n);
+	len -= n;
+	pos  = pos > n? pos - n: 0;
+}
+
+size_t
+RSP::Buffer::length() const
+{
+	return len;
+}
+
+char*
+RSP::Buffer::data() const
+{
+	return buf + pos;
+}
+
+size_t
+RSP::Buffer::available() const
+{
+	return len - pos;
+}
+
+void
+RSP::Buffer::consume(size_t n)
+{
+	pos += n;
+}
+
+bool
+RSP::Buffer::isFull() const
+{
+	return pos == 0 && len >= size;
+}
+
+void
+RSP::Buffer::pin()
+{
+	pinned = true;
+}
+
+void
+RSP::Buffer::unpin()
+{
+	pinned = false;
+}
+
+RSP::RSP(Socket* s, size_t packetSize):
+	s(s), recv_buffer(s, RSP_DEFAULT_BUFFER_SIZE, packetSize + RSP_FRAME_OVERHEAD), send_buffer(s, RSP_DEFAULT_BUFFER_SIZE)
+{
+	this->packetSize = packetSize;
+
+	noAckMode    = false;
+	running      = false;
+	nonStop      = false;
+	events       = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	job          = NULL;
+	scratch      = NULL;
+	scratch_size = 0;
+	trace        = NULL;
+	frameSize    = 0;
+	naks         = 0;
+	retransmits  = 0;
+	ackPending   = false;
+	batching     = false;
+	batchFrames  = 0;
+	corked       = false;
+	windowStart  = 0;
+	windowBytes  = 0;
+}
+
+RSP::~RSP()
+{
+	//first: its work may still signal the eventfd
+	endJob();
+
+	if(scratch) {
+		delete[] scratch;
+		scratch = NULL;
+	}
+	if(trace) {
+		delete trace;
+		trace = NULL;
+	}
+	if(events >= 0) {
+		::close(events);
+		events = -1;
+	}
+}
+
+void
+RSP::setBlocking(bool blocking)
+{
+	recv_buffer.setBlocking(blocking);
+}
+
+bool
+RSP::isBlocking() const
+{
+	return recv_buffer.isBlocking();
+}
+
+void
+RSP::beginBatch()
+{
+	batching    = true;
+	batchFrames = 0;
+}
+
+void
+RSP::endBatch()
+{
+	flushAck();
+
+	if(corked) {
+		//push out what the cork held back
+		s->cork(false);
+		corked = false;
+	}
+	batching = false;
+}
+
+int
+RSP::fill()
+{
+	return recv_buffer.fill();
+}
+
+int
+RSP::drain()
+{
+	return send_buffer.drain();
+}
+
+bool
+RSP::isCongested() const
+{
+	return send_buffer.isCongested();
+}
+
+void
+RSP::setNoAckMode(bool noAckMode)
+{
+	this->noAckMode = noAckMode;
+}
+
+bool
+RSP::isNoAckMode() const
+{
+	return noAckMode;
+}
+
+bool
+RSP::isReliable() const
+{
+	return s->isReliable();
+}
+
+void
+RSP::setTrace(Trace* trace)
+{
+	recv_buffer.setTrace(trace);
+	send_buffer.setTrace(trace);
+
+	if(this->trace) {
+		delete this->trace;
+	}
+	this->trace = trace;
+}
+
+Trace*
+RSP::getTrace() const
+{
+	return trace;
+}
+
+size_t
+RSP::getFrameSize() const
+{
+	return frameSize;
+}
+
+uint64_t
+RSP::getBytesSent() const
+{
+	return send_buffer.getTotal();
+}
+
+void
+RSP::takeErrors(uint64_t& naks, uint64_t& retransmits)
+{
+	naks              = this->naks;
+	retransmits       = this->retransmits;
+	this->naks        = 0;
+	this->retransmits = 0;
+}
+
+void
+RSP::setPacketSize(size_t packetSize)
+{
+	this->packetSize = packetSize;
+	recv_buffer.setLimit(packetSize + RSP_FRAME_OVERHEAD);
+}
+
+size_t
+RSP::getPacketSize() const
+{
+	return packetSize;
+}
+
+void
+RSP::setRunning(bool running)
+{
+	this->running = running;
+}
+
+bool
+RSP::isRunning() const
+{
+	return running;
+}
+
+int
+RSP::getEventFd() const
+{
+	return events;
+}
+
+void
+RSP::notifyStop(int signal, uint64_t thread)
+{
+	stops.push(thread, signal);
+	wake();
+}
+
+void
+RSP::wake()
+{
+	uint64_t one = 1;
+
+	if(::write(events, &one, sizeof(one)) < 0) {
+		//the counter is saturated, the poller is woken anyway
+	}
+}
+
+void
+RSP::defer(Job* job)
+{
+	this->job = job;
+}
+
+Job*
+RSP::getJob() const
+{
+	return job;
+}
+
+void
+RSP::endJob()
+{
+	if(job) {
+		delete job;
+		job = NULL;
+	}
+}
+
+bool
+RSP::takeStop(int& signal, uint64_t& thread)
+{
+	if(stops.pop(thread, signal)) {
+		return true;
+	}
+
+	//drained: rearm the eventfd, then look again for a push that raced it
+	uint64_t count = 0;
+
+	if(::read(events, &count, sizeof(count)) < 0) {
+		//nothing posted
+	}
+	return stops.pop(thread, signal);
+}
+
+void
+RSP::setNonStop(bool nonStop)
+{
+	this->nonStop = nonStop;
+}
+
+bool
+RSP::isNonStop() const
+{
+	return nonStop;
+}
+
+int
+RSP::sendStopReply(const Stop& stop, const char* notification)
+{
+	ResponseBuilder reply(this, notification);
+
+	reply.append('T').appendInt(stop.signal, 16, 2);
+
+	if(stop.thread != 0) {
+		reply.append("thread:").appendInt(stop.thread).append(';');
+	}
+	return reply.finish();
+}
+
+int
+RSP::queueStop(int signal, uint64_t thread)
+{
+	Stop stop = {thread, signal};
+
+	pendingStops.push_back(stop);
+
+	if(pendingStops.size() > 1) {
+		//gdb collects it with vStopped after the outstanding notification
+		return 0;
+	}
+	return sendStopReply(stop, "Stop");
+}
+
+int
+RSP::sendNextStop()
+{
+	//vStopped: gdb has the front event, reply with the next one or OK
+	if(!pendingStops.empty()) {
+		pendingStops.pop_front();
+	}
+	if(pendingStops.empty()) {
+		return sendPacket("OK");
+	}
+	return sendStopReply(pendingStops.front(), NULL);
+}
+
+int
+RSP::sendAck(int ch)
+{
+	char c = ch;
+	return send_buffer.send(&c, 1);
+}
+
+void
+RSP::flushAck()
 {
-	this->s    = s;
-	this->len  = 0;
-	this->size = size;
-	this->buf  = new char[size];
-	this->cur  = NULL;
-	this->ch   = -1;
+	if(ackPending) {
+		ackPending = false;
+		sendAck('+');
+	}
 }
 
-RSP::Buffer::~Buffer()
+void
+RSP::startFrame()
 {
-	if(buf) {
-		delete[] buf;
-		buf = NULL;
+	if(noAckMode) {
+		//nothing is kept for retransmission, not even what was sent before
+		window.clear();
+		windowBytes = 0;
+	}
+	if(window.empty()) {
+		send_buffer.clear();
+		windowStart = 0;
 	}
 }
 
 void
-RSP::Buffer::dump(const char* name, const char* ptr, size_t n)
+RSP::acked()
+{
+	if(window.empty()) {
+		return;
+	}
+	windowStart += window.front();
+	windowBytes -= window.front();
+	window.pop_front();
+
+	if(window.empty()) {
+		send_buffer.clear();
+		windowStart = 0;
+	} else if(windowStart > windowBytes) {
+		//gdb never catches up completely: compact once the acked frames
+		//outweigh the kept ones, so each byte moves at most once or so
+		send_buffer.discard(windowStart);
+		windowStart = 0;
+	}
+}
+
+bool
+RSP::takeLateAcks()
 {
-	FILE*       fp    = stderr;
-	const char* p     = ptr;
-	const char* limit = ptr + n;
+	char* p       = recv_buffer.data();
+	char* limit   = p + recv_buffer.available();
+	char* out     = p;
+	bool  frame   = false;
+	int   trailer = 0;	//checksum digits to go
 
-	fprintf(fp, "%s> ", name);
 	for(; p < limit; p++) {
-		if((unsigned char) *p < 0x20 || (unsigned char) *p >= 0x7f) {
-			fprintf(fp, "\\x%02x", *p & 0xff);
-		} else {
-			fprintf(fp, "%c", *p);
+		if(trailer > 0) {
+			trailer--;
+		} else if(frame) {
+			if(*p == '#') {
+				frame   = false;
+				trailer = 2;
+			}
+		} else if(*p == '$') {
+			frame = true;
+		} else if(*p == '+') {
+			acked();
+			continue;
+		} else if(*p == '-') {
+			send_buffer.resend(windowStart);
+			retransmits++;
+			continue;
 		}
+		*out++ = *p;
 	}
-	fprintf(fp, "\n");
-	fflush(fp);
+	recv_buffer.truncate(limit - out);
+
+	return window.size() < RSP_SEND_WINDOW;
 }
 
 int
-RSP::Buffer::peek()
+RSP::transmit(struct iovec* iov, int iovcnt)
 {
-	if(this->ch >= 0) {
-		return this->ch;
+	if(batching && ++batchFrames == 2 && s->cork(true) == 0) {
+		//a burst: hold the frames back until endBatch()
+		corked = true;
 	}
-	if(cur == NULL || cur >= buf + len) {
-		if(!s->isReadable()) {
-			return -1;
-		}
-		int n = s->read(buf, size);
 
-		if(n <= 0) {
-			return -1;
-		}
-		len = n;
-		cur = buf;
-		dump("in", buf, len);
-	}
-	return *cur & 0xff;
+	iov[0].iov_base = (void*) "+";
+	iov[0].iov_len  = ackPending? 1: 0;
+	ackPending      = false;
+
+	return send_buffer.sendv(iov, iovcnt);
 }
 
-#undef getc
+int
+RSP::flushFrame()
+{
+	struct iovec iov[2];
+	size_t       n = send_buffer.available();
+
+	iov[1].iov_base = send_buffer.data();
+	iov[1].iov_len  = n;
+
+	if(transmit(iov, 2) < 0) {
+		return -1;
+	}
+	send_buffer.consume(n);
+	return n;
+}
 
 int
-RSP::Buffer::getc()
+RSP::decodePacket(char* start, char* end, bool plain, const char* &packet)
 {
-	if(this->ch >= 0) {
-		int ch = this->ch;
-		this->ch = -1;
-		return ch;
+	if(plain) {
+		//common case: hand out the payload right where it was received
+		*end   = '\0';
+		packet = start;
+		recv_buffer.pin();
+		return end - start;
 	}
-	if(cur == NULL || cur >= buf + len) {
-		int n = s->read(buf, size);
 
-		if(n <= 0) {
-			len = 0;
-			cur = NULL;
-			return -1;
+	//escapes only shrink the payload and are resolved in place,
+	//run-length encoding expands it and is decoded into scratch
+	char* escape = (char*) ::memchr(start, '}', end - start);
+	bool  rle    = ::memchr(start, '*', end - start) != NULL;
+	char* in     = start;
+	char* base  = start;
+	char* out   = escape;
+	char* limit = end;
+
+	if(rle) {
+		if(scratch_size < packetSize + 1) {
+			delete[] scratch;
+			scratch      = new char[packetSize + 1];
+			scratch_size = packetSize + 1;
 		}
-		len = n;
-		cur = buf;
-		dump("in", buf, len);
+		base  = scratch;
+		out   = scratch;
+		limit = scratch + scratch_size - 1;
+	} else {
+		in = escape;
 	}
-	return *cur++ & 0xff;
-}
 
-#undef ungetc
+	while(in < end) {
+		int ch = *in++ & 0xff;
 
-void
-RSP::Buffer::ungetc(int ch)
-{
-	this->ch = ch;
-}
+		switch(ch) {
+			case '*': //run-length encoding
+			{
+				if(out <= base || in >= end) {
+					//require preceding char to repeat
+					return -1;
+				}
+				ch = *in++ & 0xff;
 
-#undef putc
+				if(ch == '$' || ch == '+' || ch == '-') {
+					//illegal chars as the encoding
+					return -1;
+				}
 
-int
-RSP::Buffer::putc(int ch)
-{
-	if(len >= size) {
-		if(flush() < 0) {
-			return -1;
+				int repeat = ch - 29;	//available number to repeat: 4, 5, 8 to 97.
+
+				if(repeat <= 0) {
+					return -1;
+				}
+				if(out + repeat > limit) {
+					return OVERFLOWED;
+				}
+				::memset(out, out[-1], repeat);
+				out += repeat;
+				continue;
+			}
+			case '}': //escape '#', '$', and '}' by XOR-ing with 0x20
+			{
+				if(in >= end) {
+					return -1;
+				}
+				ch = (*in++ & 0xff) ^ 0x20;
+				break;
+			}
+		}
+		if(out >= limit) {
+			return OVERFLOWED;
 		}
+		*out++ = ch;
 	}
-	if(cur == NULL) {
-		cur = buf;
+	*out   = '\0';
+	packet = base;
+
+	if(!rle) {
+		recv_buffer.pin();
 	}
-	*cur++ = ch, len++;
-	return ch;
+	return out - base;
 }
 
 int
-RSP::Buffer::read(void* buffer, size_t length)
+RSP::receivePacket(const char* &packet)
 {
-	char* out   = (char*) buffer;
-	char* limit = (char*) buffer + length;
+	//the packet handed out last is released, its storage may be reused
+	recv_buffer.unpin();
+
+	//it had no reply to carry its ack
+	flushAck();
+
+	while(true) {
+		char* p     = recv_buffer.data();
+		char* limit = p + recv_buffer.available();
+		char* q     = p;
+
+		//skip to the start of a frame; acks and Ctrl-C arrive in between
+		for(; q < limit && *q != '$'; q++) {
+			if(*q == 0x03) {
+				//interrupted by Ctrl-C
+				recv_buffer.consume(q + 1 - p);
+				return INTERRUPTED;
+			}
+			if(*q == '+') {
+				acked();
+			} else if(*q == '-') {
+				//go back: the NAKed frame and every one sent after it again
+				send_buffer.resend(windowStart);
+				retransmits++;
+			}
+		}
+		recv_buffer.consume(q - p);
+
+		if(q < limit && window.size() >= RSP_SEND_WINDOW) {
+			//no more replies until gdb acks some; they may come after
+			//packets it sent on regardless
+			if(takeLateAcks()) {
+				continue;
+			}
+			if(!recv_buffer.isBlocking()) {
+				//resume on the session's next readable event
+				return AGAIN;
+			}
+			if(recv_buffer.fill() <= 0) {
+				return DISCONNECTED;
+			}
+			continue;
+		}
+
+		if(q < limit) {
+			char* start = q + 1;
+			char* end   = start;
+			bool  plain = true;
+
+			//find the end of the frame, noting whether the payload needs decoding
+			while((end += Simd::scan(end, limit - end)) < limit) {
+				if(*end == '#' || *end == '$') {
+					break;
+				}
+				plain = false;
+				end++;
+			}
+
+			if(end < limit && *end == '$') {
+				//a new frame started before this one was complete
+				recv_buffer.consume(end - q);
+				continue;
+			}
+			if(end + 3 <= limit) {
+				recv_buffer.consume(end + 3 - q);
+				frameSize = end + 3 - q;
 
-	while(out < limit) {
-		int ch = getc();
+				int hi = HEXVAL(end[1]);
+				int lo = HEXVAL(end[2]);
+				int n  = -1;
+
+				if(hi >= 0 && lo >= 0 && Simd::checksum(start, end - start) == ((hi << 4) | lo)) {
+					n = decodePacket(start, end, plain, packet);
+				}
+				if(n == OVERFLOWED) {
+					return OVERFLOWED;
+				}
+				if(n < 0) {
+					//respond with NAK
+					sendAck('-');
+					naks++;
+					continue;
+				}
+				if(!noAckMode) {
+					//sent with the reply, or before the next packet is taken
+					ackPending = true;
+				}
+				return n;
+			}
+			if(recv_buffer.isFull() && !recv_buffer.grow()) {
+				//larger than the packet size
+				recv_buffer.consume(limit - q);
+				return OVERFLOWED;
+			}
+		}
 
-		if(ch < 0) {
-			break;
+		if(!recv_buffer.isBlocking()) {
+			//the caller has to wait for the next readable event
+			return AGAIN;
+		}
+		if(recv_buffer.fill() <= 0) {
+			return DISCONNECTED;
 		}
-		*out++ = ch;
 	}
-	return out - (char*) buffer;
 }
 
 int
-RSP::Buffer::write(const void* buffer, size_t length)
+RSP::receivePacket(char* packet, size_t packet_size)
 {
-	const char* in    = (const char*) buffer;
-	const char* limit = (const char*) buffer + length;
-
-	for(; in < limit; in++) {
-		int ret = putc(*in);
+	const char* view = NULL;
+	int         n    = receivePacket(view);
 
-		if(ret < 0) {
-			break;
-		}
+	if(n < 0) {
+		return n;
+	}
+	if((size_t) n >= packet_size) {
+		return OVERFLOWED;
 	}
-	return in - (const char*) buffer;
+	::memcpy(packet, view, n + 1);
+	return n;
 }
 
 int
-RSP::Buffer::flush()
+RSP::beginPacket()
 {
-	char*  ptr       = buf;
-	size_t remaining = len;
-
-	while(remaining > 0) {
-		int n = s->write(ptr, remaining);
+	startFrame();
 
-		if(n < 0) {
-			return -1;
-		}
-		dump("out", ptr, n);
+	return send_buffer.putc('$');
+}
 
-		ptr += n, remaining -= n;
+int
+RSP::endPacket(unsigned char checksum)
+{
+	if(send_buffer.putc('#') < 0) {
+		return -1;
 	}
-	cur = NULL;
-	len = 0;
-	return ptr - buf;
+	if(send_buffer.putc(HEXCHAR(checksum >> 4)) < 0) {
+		return -1;
+	}
+	if(send_buffer.putc(HEXCHAR(checksum)) < 0) {
+		return -1;
+	}
+	return commitPacket();
 }
 
-RSP::RSP(Socket* s, size_t size):
-	recv_buffer(s, size), send_buffer(s, size)
+//a notification is not acked; it goes out after the frame kept for
+//retransmission and is dropped from the buffer once written
+int
+RSP::beginNotification()
 {
-	noAckMode = false;
+	return send_buffer.putc('%');
 }
 
-RSP::~RSP()
+int
+RSP::endNotification(unsigned char checksum, size_t len)
 {
+	if(send_buffer.putc('#') < 0) {
+		return -1;
+	}
+	if(send_buffer.putc(HEXCHAR(checksum >> 4)) < 0) {
+		return -1;
+	}
+	if(send_buffer.putc(HEXCHAR(checksum)) < 0) {
+		return -1;
+	}
+	if(flushFrame() < 0) {
+		return -1;
+	}
+	send_buffer.truncate(len + 4);
+	return 0;
 }
 
-bool
-RSP::isInterrupted()
+int
+RSP::commitPacket()
 {
-	int ch = recv_buffer.peek();
+	size_t frame = send_buffer.length() - windowStart - windowBytes;
 
-	if(ch == 0x03) {
-		recv_buffer.getc();
-		return true;
+	if(flushFrame() < 0) {
+		return -1;
+	}
+	if(noAckMode) {
+		return 0;
 	}
-	return false;
-}
 
-void
-RSP::setNoAckMode(bool noAckMode)
-{
-	this->noAckMode = noAckMode;
+	//kept for retransmission until gdb acks it; acks are picked up by
+	//receivePacket(), which takes no more packets while too many are owed
+	window.push_back(frame);
+	windowBytes += frame;
+	return 0;
 }
 
-bool
-RSP::isNoAckMode() const
+int
+RSP::sendPacket(const char* buffer, size_t len)
 {
-	return noAckMode;
+	if(len == 0) {
+		len = ::strlen(buffer);
+	}
+	if(noAckMode && Simd::scan(buffer, len) == len) {
+		//nothing to escape and nothing kept for retransmission: the
+		//payload goes out from where it is
+		unsigned char checksum = Simd::checksum(buffer, len);
+		char          trailer[3] = {'#', HEXCHAR(checksum >> 4), HEXCHAR(checksum)};
+		struct iovec  iov[4];
+
+		startFrame();
+
+		iov[1].iov_base = (void*) "$";
+		iov[1].iov_len  = 1;
+		iov[2].iov_base = (void*) buffer;
+		iov[2].iov_len  = len;
+		iov[3].iov_base = trailer;
+		iov[3].iov_len  = sizeof(trailer);
+		return transmit(iov, 4) < 0? -1: len;
+	}
+	return ResponseBuilder(this).append(buffer, len).finish();
 }
 
+//a frame built by frame(), sent with a single write and no checksumming
 int
-RSP::receivePacket(char* packet, size_t packet_size)
+RSP::sendFrame(const char* frame, size_t len)
 {
-	int   state     = STATE_INIT;
-	int   checksum  = 0;
-	int   checkcode = 0;
-	char* out       = packet;
-	char* limit     = packet + packet_size - 1;
-
-	while(out < limit && state != STATE_VERIFIED) {
-		int ch = recv_buffer.getc();
-
-		if(ch < 0) {
-			return DISCONNECTED;
-		}
+	startFrame();
 
-		if(ch == '$') {
-			state     = STATE_CMD;
-			checksum  = 0;
-			checkcode = 0;
-			out       = packet;
-			continue;
-		}
-		if(ch == '#') {
-			if(state == STATE_CMD) {
-				state = STATE_CHECKSUM1;
-				continue;
-			}
-			goto reset;
-		}
+	if(noAckMode) {
+		struct iovec iov[2];
 
-		switch(state) {
-			case STATE_INIT:
-			{
-				if(ch == 0x03) {
-					//interrupted by Ctrl-C
-					return INTERRUPTED;
-				}
-				continue;
-			}
-			case STATE_CMD:
-			{
-				checksum += ch;
-
-				switch(ch) {
-					case '*': //run-length encoding
-					{
-						if(out > packet) {
-							//require preceding char to repeat
-							goto reset;
-						}
-
-						if((ch = recv_buffer.getc()) < 0) {
-							return DISCONNECTED;
-						}
-						if(ch == '#' || ch == '$' || ch == '+' || ch == '-') {
-							//illegal chars as the encoding
-							goto reset;
-						}
-						checksum += ch;
-
-						int repeat = ch - 29;	//available number to repeat: 4, 5, 8 to 97.
-
-						for(ch = out[-1]; repeat > 0 && out < limit; repeat--) {
-							*out++ = ch;
-						}
-						continue;
-					}
-					case '}': //escape '#', '$', and '}' by XOR-ing with 0x20 
-					{
-						if((ch = recv_buffer.getc()) < 0) {
-							return DISCONNECTED;
-						}
-						checksum += ch;
-						*out++ = ch ^ 0x20;
-						continue;
-					}
-				}
-				*out++ = ch;
-				continue;
-			}
-			case STATE_CHECKSUM1:
-			case STATE_CHECKSUM2:
-			{
-				if((ch = HEXVAL(ch)) < 0) {
-					//invalid hex char
-					goto reset;
-				}
-				checkcode = (checkcode << 4) + ch;
-
-				switch(state) {
-					case STATE_CHECKSUM1:
-					{	state = STATE_CHECKSUM2;
-						continue;
-					}
-					case STATE_CHECKSUM2:
-					{	if((checksum & 0xff) == checkcode) {
-							state = STATE_VERIFIED;
-							continue;
-						}
-						//pass thru
-					}
-				}
-				//pass thru
-			}
-			default:
-			reset:
-			{
-				state     = STATE_INIT;
-				checksum  = 0;
-				checkcode = 0;
-				out       = packet;
-
-				//respond with NAK
-				send_buffer.putc('-');
-				send_buffer.flush();
-				continue;
-			}
-		}
+		iov[1].iov_base = (void*) frame;
+		iov[1].iov_len  = len;
+		return transmit(iov, 2) < 0? -1: len;
 	}
 
-	if(state == STATE_VERIFIED) {
-		*out = '\0';
-
-		if(!noAckMode) {
-			send_buffer.putc('+');
-		}
-		send_buffer.flush();
-		return out - packet;
+	if(send_buffer.write(frame, len) < 0) {
+		return -1;
+	}
+	if(commitPacket() < 0) {
+		return -1;
 	}
-	//buffer was too small
-	return OVERFLOWED;
+	return len;
 }
 
 int
-RSP::sendPacket(const char* buffer, size_t len)
+RSP::sendPacketHex(const void* data, size_t len)
 {
-	int         checksum = 0;
-	const char* in       = buffer;
+	return sendPacketHex("", data, len);
+}
 
-	if(len == 0) {
-		for(; *in; in++, len++) {
-			checksum += *in & 0xff;
-		}
-	} else {
-		const char* limit = buffer + len;
+int
+RSP::sendPacketHex(const char* prefix, const void* data, size_t len, bool runLength)
+{
+	return ResponseBuilder(this).append(prefix).appendHex(data, len, runLength).finish();
+}
 
-		for(; in < limit; in++) {
-			checksum += *in & 0xff;
+//"$payload#cs" with '#', '$', '*' and '}' escaped, for sendFrame()
+string
+RSP::frame(const char* buf, size_t len)
+{
+	string        frame    = "$";
+	const char*   limit    = buf + len;
+	unsigned char checksum = 0;
+
+	while(buf < limit) {
+		size_t n = Simd::scan(buf, limit - buf);
+
+		frame.append(buf, n);
+		checksum += Simd::checksum(buf, n);
+		buf      += n;
+
+		if(buf < limit) {
+			frame    += '}';
+			frame    += (char) (*buf ^ 0x20);
+			checksum += '}' + (*buf ^ 0x20);
+			buf++;
 		}
 	}
+	frame += '#';
+	frame += HEXCHAR(checksum >> 4);
+	frame += HEXCHAR(checksum);
+	return frame;
+}
 
-	while(true) {
-		if(send_buffer.putc('$') < 0) {
-			return -1;
-		}
-		if(send_buffer.write(buffer, len) != len) {
-			return -1;
-		}
-		if(send_buffer.putc('#') < 0) {
-			return -1;
-		}
-		if(send_buffer.putc(HEXCHAR(checksum >> 4)) < 0) {
-			return -1;
-		}
-		if(send_buffer.putc(HEXCHAR(checksum)) < 0) {
-			return -1;
-		}
-		if(send_buffer.flush() < 0) {
-			return -1;
-		}
-		if(noAckMode) {
-			break;
-		}
+//'X*c' stands for X repeated c - 29 more times; c must be printable and
+//must not be '#' or '$', nor '+' or '-' which could pass for an ack
+size_t
+RSP::encodeRuns(char* buf, size_t len)
+{
+	const char* in    = buf;
+	const char* limit = buf + len;
+	char*       out   = buf;
 
-		int ch = recv_buffer.getc();
+	while(in < limit) {
+		const char* run = in + 1;
 
-		if(ch < 0) {
-			return -1;
+		while(run < limit && *run == *in && run - in <= RLE_MAX_REPEAT) {
+			run++;
 		}
-		if(ch == '$') {
-			recv_buffer.ungetc(ch);
-			break;
+
+		size_t repeat = run - in - 1;
+
+		if(repeat < RLE_MIN_REPEAT) {
+			//too short to pay for '*' and the count
+			while(in < run) {
+				*out++ = *in++;
+			}
+			continue;
 		}
-		if(ch == '+') {
-			break;
+		while(strchr("#$+-", (int) (repeat + 29)) != NULL) {
+			repeat--;
 		}
+		*out++ = *in;
+		*out++ = '*';
+		*out++ = (char) (repeat + 29);
+		in    += repeat + 1;
 	}
-	return len;
+	return out - buf;
 }
 
 int
 RSP::sendPacketFormatV(const char* fmt, va_list args)
 {
-	char*  buf = NULL;
-	size_t len = vasprintf(&buf, fmt, args);
-
-	if(buf == NULL) {
-		return -1;
-	}
-	return sendPacket(buf, len);
+	return ResponseBuilder(this).formatV(fmt, args).finish();
 }
 
 int
@@ -418,12 +1188,10 @@ RSP::sendPacketFormat(const char* fmt, ...)
 string
 RSP::unhexify(const string& str)
 {
-	const char* p      = str.c_str();
-	const char* limit  = str.c_str() + str.length();
-	string      result = "";
+	string result(str.length() / 2, '\0');
 
-	for(; p + 1 < limit; p += 2) {
-		result += char((HEXVAL(p[0]) << 4) + HEXVAL(p[1]));
+	if(Hex::decode(&result[0], str.c_str(), str.length()) < 0) {
+		return "";
 	}
 	return result;
 }
@@ -431,14 +1199,9 @@ RSP::unhexify(const string& str)
 string
 RSP::hexify(const string& str)
 {
-	const char* p      = str.c_str();
-	const char* limit  = str.c_str() + str.length();
-	string      result = "";
+	string result(2 * str.length(), '\0');
 
-	for(; p < limit; p++) {
-		result += char(HEXCHAR(*p >> 4));
-		result += char(HEXCHAR(*p));
-	}
+	Hex::encode(&result[0], str.c_str(), str.length());
 	return result;
 }
 
@@ -482,4 +1245,78 @@ RSP::getNextParamInt(const char* &ptr, int &param, int base)
 	return false;
 }
 
+bool
+RSP::getNextParamInt(const char* &ptr, unsigned long long &param, int base)
+{
+	string str = "";
+
+	if(getNextParamStr(ptr, str) && str.length() > 0) {
+		char* last = NULL;
+
+		param = strtoull(str.c_str(), &last, base);
+
+		if(*last == '\0') {
+			return true;
+		}
+	}
+	return false;
+}
+
+//splits off the text up to the next ':', ';' or ','; false once ptr is empty
+bool
+RSP::getNextParam(string_view& ptr, string_view& param)
+{
+	if(ptr.empty()) {
+		return false;
+	}
+
+	size_t sep = ptr.find_first_of(":;,");
+
+	if(sep == string_view::npos) {
+		param = ptr;
+		ptr   = string_view();
+		return true;
+	}
+	param = ptr.substr(0, sep);
+	ptr.remove_prefix(sep + 1);
+	return true;
+}
+
+bool
+RSP::getNextParamInt(string_view& ptr, unsigned long long &param, int base)
+{
+	string_view str;
+
+	return getNextParam(ptr, str) && parseInt(str, param, base);
+}
+
+//the whole of str must be digits of base, optionally after a '-'
+bool
+RSP::parseInt(string_view str, unsigned long long &value, int base)
+{
+	bool negative = !str.empty() && str[0] == '-';
+
+	if(negative) {
+		str.remove_prefix(1);
+	}
+	if(str.empty()) {
+		return false;
+	}
+
+	value = 0;
+
+	for(size_t i = 0; i < str.length(); i++) {
+		int digit = HEXVAL(str[i]);
+
+		if(digit < 0 || digit >= base) {
+			return false;
+		}
+		value = value * base + digit;
+	}
+	if(negative) {
+		value = -value;
+	}
+	return true;
+}
+
 }; // endof namespace gdb
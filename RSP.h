@@ -5,60 +5,132 @@
 
 #include "Port.h"
 #include "Socket.h"
+#include "Hex.h"
+#include "StopQueue.h"
+#include "Trace.h"
+#include "Job.h"
+#include <string_view>
+#include <deque>
 
 #define RSP_DEFAULT_BUFFER_SIZE		(4096)
 
-#define HEXVAL(ch) \
-	((ch) >= '0' && (ch) <= '9'? ch - '0': \
-	 (ch) >= 'a' && (ch) <= 'f'? ch - 'a' + 10: \
-	 (ch) >= 'A' && (ch) <= 'F'? ch - 'A' + 10: -1)
+//'$', '#' and the checksum around a payload of the packet size
+#define RSP_FRAME_OVERHEAD		(4)
 
-#define HEXCHAR(val) \
-	(((val & 0xf) <= 9)? (val & 0xf) + '0': (val & 0xf) - 10 + 'a')
+//frames sent ahead of gdb's acks in ack mode
+#define RSP_SEND_WINDOW			(16)
+
+#define HEXVAL(ch)	(gdb::Hex::values[(ch) & 0xff])
+
+#define HEXCHAR(val)	(gdb::Hex::digits[(val) & 0xf])
 
 namespace gdb {
 
-	enum {
-		STATE_INIT,
-		STATE_CMD,
-		STATE_CHECKSUM1,
-		STATE_CHECKSUM2,
-		STATE_VERIFIED
-	};
+	class ResponseBuilder;
 
 	class RSP
 	{
+		friend class ResponseBuilder;
+
 		class Buffer
 		{
-			Socket* s;
-			size_t  len;
-			size_t  size;
-			char*   buf;
-			char*   cur;
-			int     ch;
-
-			void
-			dump(const char* name, const char* ptr, size_t n);
+			Socket*  s;
+			size_t   len;
+			size_t   size;
+			size_t   limit;	//size grow() stops at, 0 for none
+			char*    buf;
+			char*    spare;	//recv: takes over while buf is pinned
+			size_t   spare_size;
+			size_t   pos;	//recv: next byte to read; send: next byte to flush
+			bool     blocking;
+			bool     pinned;	//recv: buf holds a packet handed out by receivePacket()
+			Trace*   trace;	//records the bytes that pass the socket, NULL when off
+			uint64_t total;	//bytes that passed the socket
+			string   pending;	//send: taken while the socket was full, written by drain()
+			size_t   pending_pos;
 
 		public:
-			Buffer(Socket* s, size_t size);
+			Buffer(Socket* s, size_t size, size_t limit = 0);
 
 			~Buffer();
 
-			int
-			peek();
+			void
+			setBlocking(bool blocking);
+
+			bool
+			isBlocking() const;
+
+			//doubles the storage, keeping the content; false at the limit
+			bool
+			grow();
+
+			void
+			setLimit(size_t limit);
+
+			void
+			setTrace(Trace* trace);
+
+			uint64_t
+			getTotal() const;
 
 			int
-			getc();
+			fill();
 
 			void
-			ungetc(int ch);
+			clear();
 
+			//writes everything from offset on again
 			int
-			putc(int ch);
+			resend(size_t offset);
+
+			int
+			send(const void* buf, size_t len);
 
+			//writes all of iov, consuming it, and keeps what the socket does not
+			//take for drain(); returns the bytes taken
 			int
-			read(void* buf, size_t len);
+			sendv(struct iovec* iov, int iovcnt);
+
+			//writes what sendv() kept; returns the bytes still kept
+			int
+			drain();
+
+			bool
+			isCongested() const;
+
+			char*
+			append(size_t n);
+
+			void
+			truncate(size_t n);
+
+			//drops n bytes from the front
+			void
+			discard(size_t n);
+
+			size_t
+			length() const;
+
+			char*
+			data() const;
+
+			size_t
+			available() const;
+
+			void
+			consume(size_t n);
+
+			bool
+			isFull() const;
+
+			void
+			pin();
+
+			void
+			unpin();
+
+			int
+			putc(int ch);
 
 			int
 			write(const void* buf, size_t len);
@@ -67,23 +139,126 @@ namespace gdb {
 			flush();
 		};
 
-		bool   noAckMode;
-		Buffer recv_buffer;
-		Buffer send_buffer;
+		struct Stop
+		{
+			uint64_t thread;
+			int      signal;
+		};
+
+		bool        noAckMode;
+		bool        running;		//resumed, a stop reply is owed
+		bool        nonStop;
+		int         events;		//eventfd, signalled by notifyStop() and wake()
+		Job*        job;		//owed the reply to the last packet, owned
+		StopQueue   stops;		//posted by notifyStop(), drained by takeStop()
+		deque<Stop> pendingStops;	//non-stop: the front is reported, waiting for vStopped
+		Socket*     s;
+		Buffer      recv_buffer;
+		Buffer      send_buffer;		//ack mode: the frames gdb has not acked, oldest first
+
+		deque<size_t> window;		//lengths of the frames kept in send_buffer
+		size_t        windowStart;	//offset of the oldest, acked frames before it
+		size_t        windowBytes;	//their sum
+
+		size_t      packetSize;		//largest payload accepted, advertised in qSupported
+		char*       scratch;		//decoded run-length encoded packets
+		size_t      scratch_size;
+		Trace*      trace;		//owned, shared by both buffers
+		size_t      frameSize;		//on the wire, of the last packet received
+		uint64_t    naks;		//sent since takeErrors()
+		uint64_t    retransmits;	//since takeErrors()
+		bool        ackPending;		//'+' for the last packet, sent in front of the reply
+		bool        batching;		//between beginBatch() and endBatch()
+		int         batchFrames;	//frames sent in this batch
+		bool        corked;
+
+		int
+		sendAck(int ch);
+
+		void
+		flushAck();
+
+		//makes room for the next frame in send_buffer
+		void
+		startFrame();
+
+		//the oldest frame in the window got its '+'
+		void
+		acked();
+
+		//gdb sent on while RSP_SEND_WINDOW frames are unacked: takes the
+		//acks from between its packets; false if the window is still full
+		bool
+		takeLateAcks();
+
+		//writes iov[1..] after the pending ack, which takes iov[0]
+		int
+		transmit(struct iovec* iov, int iovcnt);
+
+		//the unsent part of send_buffer
+		int
+		flushFrame();
+
+		int
+		decodePacket(char* start, char* end, bool plain, const char* &packet);
+
+		int
+		beginPacket();
+
+		int
+		endPacket(unsigned char checksum);
+
+		int
+		commitPacket();
+
+		int
+		beginNotification();
+
+		int
+		endNotification(unsigned char checksum, size_t len);
+
+		int
+		sendStopReply(const Stop& stop, const char* notification);
 
 	public:
-		RSP(Socket* s, size_t size = RSP_DEFAULT_BUFFER_SIZE);
+		//buffers start at the default size and grow up to the packet size
+		RSP(Socket* s, size_t packetSize = RSP_DEFAULT_BUFFER_SIZE);
 
 		~RSP();
 
 		enum {
 			DISCONNECTED = -1,
 			INTERRUPTED  = -2,
-			OVERFLOWED   = -3
+			OVERFLOWED   = -3,
+			AGAIN        = -4
 		};
 
+		void
+		setBlocking(bool blocking);
+
+		bool
+		isBlocking() const;
+
+		//replies sent until endBatch() are corked after the first and
+		//leave together
+		void
+		beginBatch();
+
+		void
+		endBatch();
+
+		//reads what the socket has; AGAIN if nothing
+		int
+		fill();
+
+		//writes the replies the socket could not take when they were sent;
+		//returns the bytes still waiting for it
+		int
+		drain();
+
+		//replies are waiting for the socket: take no more packets
 		bool
-		isInterrupted();
+		isCongested() const;
 
 		void
 		setNoAckMode(bool noAckMode);
@@ -91,18 +266,114 @@ namespace gdb {
 		bool
 		isNoAckMode() const;
 
+		//no-ack mode is worth offering
+		bool
+		isReliable() const;
+
+		//captures the session's traffic from now on, NULL stops it;
+		//the RSP owns the trace
+		void
+		setTrace(Trace* trace);
+
+		Trace*
+		getTrace() const;
+
+		//the frame of the packet last returned by receivePacket(), '$' to checksum
+		size_t
+		getFrameSize() const;
+
+		uint64_t
+		getBytesSent() const;
+
+		//NAKs sent and packets sent again since the last call
+		void
+		takeErrors(uint64_t& naks, uint64_t& retransmits);
+
+		void
+		setPacketSize(size_t packetSize);
+
+		size_t
+		getPacketSize() const;
+
+		void
+		setRunning(bool running);
+
+		bool
+		isRunning() const;
+
+		int
+		getEventFd() const;
+
+		//reports a target stop from any thread; wakes the session's poller
+		void
+		notifyStop(int signal, uint64_t thread = 0);
+
+		//wakes the session's poller, from any thread
+		void
+		wake();
+
+		//the reply to the packet being handled is left to job, continued by the
+		//session loop; takes ownership
+		void
+		defer(Job* job);
+
+		//NULL unless a deferred reply is still being worked out
+		Job*
+		getJob() const;
+
+		//the job sent its reply: deletes it
+		void
+		endJob();
+
+		//session thread: the next stop posted by notifyStop()
+		bool
+		takeStop(int& signal, uint64_t& thread);
+
+		void
+		setNonStop(bool nonStop);
+
+		bool
+		isNonStop() const;
+
+		//non-stop: reports a stop as a %Stop notification, or keeps it for
+		//vStopped while a notification is outstanding
+		int
+		queueStop(int signal, uint64_t thread = 0);
+
+		//answers vStopped
+		int
+		sendNextStop();
+
+		int
+		receivePacket(const char* &packet);
+
 		int
 		receivePacket(char* packet, size_t packet_size);
 
 		int
 		sendPacket(const char* buffer, size_t len = 0);
 
+		int
+		sendPacketHex(const void* data, size_t len);
+
+		int
+		sendPacketHex(const char* prefix, const void* data, size_t len, bool runLength = false);
+
+		int
+		sendFrame(const char* frame, size_t len);
+
 		int
 		sendPacketFormat(const char* fmt, ...);
 
 		int
 		sendPacketFormatV(const char* fmt, va_list args);
 
+		static size_t
+		encodeRuns(char* buf, size_t len);
+
+		static string
+		frame(const char* buf, size_t len);
+
 		static string
 		unhexify(const string& str);
 
@@ -114,6 +385,19 @@ namespace gdb {
 
 		static bool
 		getNextParamInt(const char* &ptr, int &param, int base = 10);
+
+		static bool
+		getNextParamInt(const char* &ptr, unsigned long long &param, int base = 10);
+
+		//views into the packet: no copies, no NUL termination needed
+		static bool
+		getNextParam(string_view& ptr, string_view& param);
+
+		static bool
+		getNextParamInt(string_view& ptr, unsigned long long &param, int base = 16);
+
+		static bool
+		parseInt(string_view str, unsigned long long &value, int base = 16);
 	};
 
 }; // endof namespace gdb
@@ -0,0 +1,252 @@
+#include "ResponseBuilder.h"
+#include "Simd.h"
+#include <stdio.h>
+#include <string.h>
+
+#define BUILDER_FORMAT_SIZE		(128)
+
+namespace gdb {
+
+ResponseBuilder::ResponseBuilder(RSP* rsp, const char* notification)
+{
+	this->rsp          = rsp;
+	this->checksum     = 0;
+	this->length       = 0;
+	this->notification = notification != NULL;
+
+	if(notification == NULL) {
+		this->failed = rsp->beginPacket() < 0;
+	} else {
+		this->failed = rsp->beginNotification() < 0;
+	}
+	//the frame marker is the last byte in, unless putting it failed
+	this->start = rsp->send_buffer.length() - (failed? 0: 1);
+
+	if(notification != NULL) {
+		append(notification).append(':');
+	}
+}
+
+ResponseBuilder::~ResponseBuilder()
+{
+}
+
+char*
+ResponseBuilder::reserve(size_t n)
+{
+	if(failed) {
+		return NULL;
+	}
+
+	char* p = rsp->send_buffer.append(n);
+
+	if(p == NULL) {
+		failed = true;
+	}
+	return p;
+}
+
+void
+ResponseBuilder::rollback()
+{
+	//frames before start are still owed to gdb and stay
+	if(rsp->send_buffer.length() > start) {
+		rsp->send_buffer.truncate(rsp->send_buffer.length() - start);
+	}
+}
+
+void
+ResponseBuilder::commit(const char* p, size_t n)
+{
+	checksum += Simd::checksum(p, n);
+	length   += n;
+}
+
+ResponseBuilder&
+ResponseBuilder::append(char ch)
+{
+	return append(&ch, 1);
+}
+
+ResponseBuilder&
+ResponseBuilder::append(const char* str)
+{
+	return append(str, ::strlen(str));
+}
+
+ResponseBuilder&
+ResponseBuilder::append(const void* buf, size_t len)
+{
+	const char* in    = (const char*) buf;
+	const char* limit = in + len;
+
+	while(in < limit) {
+		//copy the run up to the next byte that has to be escaped
+		size_t n = Simd::scan(in, limit - in);
+		char*  p = reserve(n);
+
+		if(p == NULL) {
+			break;
+		}
+		::memcpy(p, in, n);
+		commit(p, n);
+		in += n;
+
+		if(in < limit) {
+			//escape '#', '$', '*' and '}' by XOR-ing with 0x20
+			if((p = reserve(2)) == NULL) {
+				break;
+			}
+			p[0] = '}';
+			p[1] = *in++ ^ 0x20;
+			commit(p, 2);
+		}
+	}
+	return *this;
+}
+
+ResponseBuilder&
+ResponseBuilder::appendHex(const void* data, size_t len, bool runLength)
+{
+	//hex digits never need escaping; encode straight into the frame
+	char* p = reserve(2 * len);
+
+	if(p == NULL) {
+		return *this;
+	}
+	Hex::encode(p, data, len);
+
+	size_t n = 2 * len;
+
+	if(runLength) {
+		//the encoded payload is never longer, give back what it saved
+		n = RSP::encodeRuns(p, 2 * len);
+		rsp->send_buffer.truncate(2 * len - n);
+	}
+	commit(p, n);
+	return *this;
+}
+
+ResponseBuilder&
+ResponseBuilder::appendInt(unsigned long long value, int base, int width)
+{
+	char digits[64];
+	int  n = 0;
+
+	do {
+		digits[n++] = HEXCHAR(value % base);
+		value      /= base;
+	} while(value > 0 && n < (int) sizeof(digits));
+
+	while(n < width && n < (int) sizeof(digits)) {
+		digits[n++] = '0';
+	}
+
+	char* p = reserve(n);
+
+	if(p == NULL) {
+		return *this;
+	}
+	for(int i = 0; i < n; i++) {
+		p[i] = digits[n - 1 - i];
+	}
+	commit(p, n);
+	return *this;
+}
+
+ResponseBuilder&
+ResponseBuilder::format(const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	formatV(fmt, args);
+	va_end(args);
+	return *this;
+}
+
+ResponseBuilder&
+ResponseBuilder::formatV(const char* fmt, va_list args)
+{
+	va_list copy;
+	char*   p = reserve(BUILDER_FORMAT_SIZE);
+
+	if(p == NULL) {
+		return *this;
+	}
+
+	va_copy(copy, args);
+
+	int n = vsnprintf(p, BUILDER_FORMAT_SIZE, fmt, args);
+
+	if(n < 0) {
+		rsp->send_buffer.truncate(BUILDER_FORMAT_SIZE);
+		failed = true;
+		goto leave;
+	}
+	if(n >= BUILDER_FORMAT_SIZE) {
+		//too long for the first try: print again into exactly enough room
+		rsp->send_buffer.truncate(BUILDER_FORMAT_SIZE);
+
+		if((p = reserve(n + 1)) == NULL) {
+			goto leave;
+		}
+		vsnprintf(p, n + 1, fmt, copy);
+		rsp->send_buffer.truncate(1);
+	} else {
+		rsp->send_buffer.truncate(BUILDER_FORMAT_SIZE - n);
+	}
+
+	{
+		//escape in place, moving the text up by one byte per special byte
+		size_t specials = 0;
+
+		for(size_t i = Simd::scan(p, n); i < (size_t) n; i += 1 + Simd::scan(p + i + 1, n - i - 1)) {
+			specials++;
+		}
+		if(specials > 0) {
+			char* tail = reserve(specials);
+
+			if(tail == NULL) {
+				goto leave;
+			}
+			p = tail - n;
+
+			for(char* in = p + n, *out = tail + specials; in > p; ) {
+				char ch = *--in;
+
+				if(ch == '#' || ch == '$' || ch == '*' || ch == '}') {
+					*--out = ch ^ 0x20;
+					*--out = '}';
+				} else {
+					*--out = ch;
+				}
+			}
+		}
+		commit(p, n + specials);
+	}
+
+leave:
+	va_end(copy);
+	return *this;
+}
+
+int
+ResponseBuilder::finish()
+{
+	int ret = -1;
+
+	if(!failed) {
+		if(notification) {
+			ret = rsp->endNotification(checksum, length);
+		} else {
+			ret = rsp->endPacket(checksum);
+		}
+	}
+	if(ret < 0) {
+		rollback();
+		return -1;
+	}
+	return length;
+}
+
+}; //namespace gdb
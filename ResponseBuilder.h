@@ -0,0 +1,66 @@
+#ifndef __ResponseBuilder__h__
+#define __ResponseBuilder__h__
+
+#include <stdarg.h>
+#include <stddef.h>
+#include "RSP.h"
+
+namespace gdb {
+
+	//builds one packet in place in the send buffer of an RSP: payload bytes
+	//are escaped and checksummed as they are appended, finish() closes the
+	//frame and sends it; nothing is allocated once the buffer has grown
+	class ResponseBuilder
+	{
+		RSP*          rsp;
+		unsigned char checksum;
+		size_t        length;	//payload bytes as they appear in the frame
+		bool          notification;
+		bool          failed;
+		size_t        start;	//send buffer length before the frame's first byte
+
+		char*
+		reserve(size_t n);
+
+		//drops what a failed frame left in the send buffer
+		void
+		rollback();
+
+		void
+		commit(const char* p, size_t n);
+
+	public:
+		//with a name, builds the %name:... notification instead of a packet
+		ResponseBuilder(RSP* rsp, const char* notification = NULL);
+
+		~ResponseBuilder();
+
+		ResponseBuilder&
+		append(char ch);
+
+		ResponseBuilder&
+		append(const char* str);
+
+		ResponseBuilder&
+		append(const void* buf, size_t len);
+
+		ResponseBuilder&
+		appendHex(const void* data, size_t len, bool runLength = false);
+
+		ResponseBuilder&
+		appendInt(unsigned long long value, int base = 16, int width = 0);
+
+		ResponseBuilder&
+		format(const char* fmt, ...);
+
+		ResponseBuilder&
+		formatV(const char* fmt, va_list args);
+
+		//returns the payload length, or -1 if the packet could not be built or sent
+		int
+		finish();
+	};
+
+}; //namespace gdb
+
+#endif/*__ResponseBuilder__h__*/
@@ -0,0 +1,54 @@
+#include "Session.h"
+
+namespace gdb {
+
+Session::Session(Socket* s, size_t packetSize)
+{
+	this->s       = s;
+	this->rsp     = new RSP(s, packetSize);
+	this->resumed = NULL;
+}
+
+Session::~Session()
+{
+	if(rsp) {
+		delete rsp;
+		rsp = NULL;
+	}
+	if(s) {
+		delete s;
+		s = NULL;
+	}
+}
+
+int
+Session::getFd() const
+{
+	return s->getFd();
+}
+
+int
+Session::getOutputFd() const
+{
+	return s->getOutputFd();
+}
+
+RSP*
+Session::getRSP() const
+{
+	return rsp;
+}
+
+void
+Session::setResumed(Handler* handler)
+{
+	resumed = handler;
+}
+
+Handler*
+Session::getResumed() const
+{
+	return resumed;
+}
+
+}; //namespace gdb
@@ -0,0 +1,42 @@
+#ifndef __Session__h__
+#define __Session__h__
+
+#include "Socket.h"
+#include "RSP.h"
+
+namespace gdb {
+
+	class Handler;
+
+	//one debugger connection: its socket and protocol state
+	class Session
+	{
+		Socket*  s;
+		RSP*     rsp;
+		Handler* resumed;	//owes the stop reply while the target runs
+
+	public:
+		Session(Socket* s, size_t packetSize = RSP_DEFAULT_BUFFER_SIZE);
+
+		~Session();
+
+		int
+		getFd() const;
+
+		//where the replies go: stdout for a stdio session, getFd() otherwise
+		int
+		getOutputFd() const;
+
+		RSP*
+		getRSP() const;
+
+		void
+		setResumed(Handler* handler);
+
+		Handler*
+		getResumed() const;
+	};
+
+}; //namespace gdb
+
+#endif/*__Session__h__*/
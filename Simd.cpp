@@ -0,0 +1,330 @@
+#include "Simd.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SIMD_X86	1
+#endif
+
+namespace gdb {
+
+namespace {
+
+typedef unsigned char (*ChecksumFunc)(const unsigned char* p, size_t len);
+typedef size_t        (*ScanFunc)(const unsigned char* p, size_t len);
+typedef size_t        (*FindFunc)(const unsigned char* p, size_t len, const unsigned char* needle, size_t m);
+
+inline bool
+isSpecial(unsigned char ch)
+{
+	return ch == '$' || ch == '#' || ch == '*' || ch == '}';
+}
+
+unsigned char
+checksumScalar(const unsigned char* p, size_t len)
+{
+	unsigned int sum = 0;
+
+	for(size_t i = 0; i < len; i++) {
+		sum += p[i];
+	}
+	return sum;
+}
+
+size_t
+scanScalar(const unsigned char* p, size_t len)
+{
+	size_t i = 0;
+
+	for(; i < len && !isSpecial(p[i]); i++) {
+	}
+	return i;
+}
+
+size_t
+findScalar(const unsigned char* p, size_t len, const unsigned char* needle, size_t m)
+{
+	const void* found = ::memmem(p, len, needle, m);
+
+	return found? (const unsigned char*) found - p: len;
+}
+
+#if SIMD_X86
+
+__attribute__((target("sse2"))) unsigned char
+checksumSSE2(const unsigned char* p, size_t len)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i       acc0 = zero;
+	__m128i       acc1 = zero;
+	size_t        i    = 0;
+
+	//psadbw against zero adds up 8 bytes into each 64-bit lane
+	for(; i + 32 <= len; i += 32) {
+		acc0 = _mm_add_epi64(acc0, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (p + i)), zero));
+		acc1 = _mm_add_epi64(acc1, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (p + i + 16)), zero));
+	}
+	for(; i + 16 <= len; i += 16) {
+		acc0 = _mm_add_epi64(acc0, _mm_sad_epu8(_mm_loadu_si128((const __m128i*) (p + i)), zero));
+	}
+	acc0 = _mm_add_epi64(acc0, acc1);
+
+	uint64_t sum = _mm_cvtsi128_si64(acc0) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(acc0, acc0));
+
+	return sum + checksumScalar(p + i, len - i);
+}
+
+__attribute__((target("sse2"))) size_t
+scanSSE2(const unsigned char* p, size_t len)
+{
+	const __m128i dollar = _mm_set1_epi8('$');
+	const __m128i hash   = _mm_set1_epi8('#');
+	const __m128i star   = _mm_set1_epi8('*');
+	const __m128i brace  = _mm_set1_epi8('}');
+	size_t        i      = 0;
+
+	for(; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*) (p + i));
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, dollar), _mm_cmpeq_epi8(v, hash)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, star),   _mm_cmpeq_epi8(v, brace)));
+		int     bits = _mm_movemask_epi8(m);
+
+		if(bits) {
+			return i + __builtin_ctz(bits);
+		}
+	}
+	return i + scanScalar(p + i, len - i);
+}
+
+//candidates are positions where both the first and the last byte of the
+//needle match; only those are compared in full
+__attribute__((target("sse2"))) size_t
+findSSE2(const unsigned char* p, size_t len, const unsigned char* needle, size_t m)
+{
+	if(m < 2 || len < m) {
+		return findScalar(p, len, needle, m);
+	}
+
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last  = _mm_set1_epi8(needle[m - 1]);
+	size_t        i     = 0;
+
+	for(; i + m - 1 + 16 <= len; i += 16) {
+		__m128i  a    = _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i*) (p + i)));
+		__m128i  b    = _mm_cmpeq_epi8(last,  _mm_loadu_si128((const __m128i*) (p + i + m - 1)));
+		unsigned bits = _mm_movemask_epi8(_mm_and_si128(a, b));
+
+		for(; bits; bits &= bits - 1) {
+			size_t pos = i + __builtin_ctz(bits);
+
+			if(::memcmp(p + pos + 1, needle + 1, m - 2) == 0) {
+				return pos;
+			}
+		}
+	}
+
+	size_t rest = findScalar(p + i, len - i, needle, m);
+
+	return rest < len - i? i + rest: len;
+}
+
+__attribute__((target("avx2"))) unsigned char
+checksumAVX2(const unsigned char* p, size_t len)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i       acc0 = zero;
+	__m256i       acc1 = zero;
+	size_t        i    = 0;
+
+	for(; i + 64 <= len; i += 64) {
+		acc0 = _mm256_add_epi64(acc0, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*) (p + i)), zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*) (p + i + 32)), zero));
+	}
+	for(; i + 32 <= len; i += 32) {
+		acc0 = _mm256_add_epi64(acc0, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*) (p + i)), zero));
+	}
+	acc0 = _mm256_add_epi64(acc0, acc1);
+
+	__m128i  half = _mm_add_epi64(_mm256_castsi256_si128(acc0), _mm256_extracti128_si256(acc0, 1));
+	uint64_t sum  = _mm_cvtsi128_si64(half) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(half, half));
+
+	return sum + checksumSSE2(p + i, len - i);
+}
+
+__attribute__((target("avx2"))) size_t
+scanAVX2(const unsigned char* p, size_t len)
+{
+	const __m256i dollar = _mm256_set1_epi8('$');
+	const __m256i hash   = _mm256_set1_epi8('#');
+	const __m256i star   = _mm256_set1_epi8('*');
+	const __m256i brace  = _mm256_set1_epi8('}');
+	size_t        i      = 0;
+
+	for(; i + 32 <= len; i += 32) {
+		__m256i  v = _mm256_loadu_si256((const __m256i*) (p + i));
+		__m256i  m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, dollar), _mm256_cmpeq_epi8(v, hash)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, star),   _mm256_cmpeq_epi8(v, brace)));
+		unsigned bits = _mm256_movemask_epi8(m);
+
+		if(bits) {
+			return i + __builtin_ctz(bits);
+		}
+	}
+	return i + scanSSE2(p + i, len - i);
+}
+
+__attribute__((target("avx2"))) size_t
+findAVX2(const unsigned char* p, size_t len, const unsigned char* needle, size_t m)
+{
+	if(m < 2 || len < m) {
+		return findScalar(p, len, needle, m);
+	}
+
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last  = _mm256_set1_epi8(needle[m - 1]);
+	size_t        i     = 0;
+
+	for(; i + m - 1 + 32 <= len; i += 32) {
+		__m256i  a    = _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i*) (p + i)));
+		__m256i  b    = _mm256_cmpeq_epi8(last,  _mm256_loadu_si256((const __m256i*) (p + i + m - 1)));
+		unsigned bits = _mm256_movemask_epi8(_mm256_and_si256(a, b));
+
+		for(; bits; bits &= bits - 1) {
+			size_t pos = i + __builtin_ctz(bits);
+
+			if(::memcmp(p + pos + 1, needle + 1, m - 2) == 0) {
+				return pos;
+			}
+		}
+	}
+
+	size_t rest = findSSE2(p + i, len - i, needle, m);
+
+	return rest < len - i? i + rest: len;
+}
+
+#endif/*SIMD_X86*/
+
+int            level         = -1;
+ChecksumFunc   checksumFunc  = checksumScalar;
+ScanFunc       scanFunc      = scanScalar;
+FindFunc       findFunc      = findScalar;
+pthread_once_t initOnce      = PTHREAD_ONCE_INIT;
+
+bool
+isSupported(int level)
+{
+	switch(level) {
+		case Simd::SCALAR:
+			return true;
+#if SIMD_X86
+		case Simd::SSE2:
+			return __builtin_cpu_supports("sse2");
+		case Simd::SSSE3:
+			return __builtin_cpu_supports("ssse3");
+		case Simd::AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+	}
+	return false;
+}
+
+void
+pickBest()
+{
+	//unless select() already forced a level
+	if(level < 0) {
+		int best = Simd::AVX2;
+
+		while(!isSupported(best)) {
+			best--;
+		}
+		Simd::select(best);
+	}
+}
+
+//the first caller picks the kernels; the others wait until they are set
+inline void
+init()
+{
+	::pthread_once(&initOnce, pickBest);
+}
+
+};
+
+bool
+Simd::select(int newLevel)
+{
+	if(!isSupported(newLevel)) {
+		return false;
+	}
+	switch(newLevel) {
+#if SIMD_X86
+		case AVX2:
+			checksumFunc = checksumAVX2;
+			scanFunc     = scanAVX2;
+			findFunc     = findAVX2;
+			break;
+		case SSSE3:	//nothing to gain over SSE2 for these
+		case SSE2:
+			checksumFunc = checksumSSE2;
+			scanFunc     = scanSSE2;
+			findFunc     = findSSE2;
+			break;
+#endif
+		default:
+			checksumFunc = checksumScalar;
+			scanFunc     = scanScalar;
+			findFunc     = findScalar;
+			break;
+	}
+	level = newLevel;
+	return true;
+}
+
+int
+Simd::getLevel()
+{
+	init();
+	return level;
+}
+
+const char*
+Simd::getName(int level)
+{
+	switch(level) {
+		case SCALAR: return "scalar";
+		case SSE2:   return "sse2";
+		case SSSE3:  return "ssse3";
+		case AVX2:   return "avx2";
+	}
+	return "unknown";
+}
+
+unsigned char
+Simd::checksum(const void* buf, size_t len)
+{
+	init();
+	return checksumFunc((const unsigned char*) buf, len);
+}
+
+size_t
+Simd::scan(const void* buf, size_t len)
+{
+	init();
+	return scanFunc((const unsigned char*) buf, len);
+}
+
+size_t
+Simd::find(const void* buf, size_t len, const void* needle, size_t needle_len)
+{
+	init();
+	return findFunc((const unsigned char*) buf, len, (const unsigned char*) needle, needle_len);
+}
+
+}; //namespace gdb
@@ -0,0 +1,45 @@
+#ifndef __Simd__h__
+#define __Simd__h__
+
+#include <stddef.h>
+
+namespace gdb {
+
+	//byte kernels on the RSP hot path, picked at runtime for the host CPU
+	class Simd
+	{
+	public:
+		enum {
+			SCALAR,
+			SSE2,
+			SSSE3,
+			AVX2
+		};
+
+		//force an implementation; false if the CPU does not support it;
+		//not synchronized, so call it before the threads use the kernels
+		static bool
+		select(int level);
+
+		static int
+		getLevel();
+
+		static const char*
+		getName(int level);
+
+		//sum of all bytes modulo 256, the RSP checksum
+		static unsigned char
+		checksum(const void* buf, size_t len);
+
+		//offset of the first '$', '#', '*' or '}' in buf, or len if there is none
+		static size_t
+		scan(const void* buf, size_t len);
+
+		//offset of the first occurrence of needle in buf, or len if there is none
+		static size_t
+		find(const void* buf, size_t len, const void* needle, size_t needle_len);
+	};
+
+}; //namespace gdb
+
+#endif/*__Simd__h__*/
@@ -10,6 +10,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 
 //////////////////////////////////////////////////////////////////
 
@@ -34,11 +35,31 @@ public:
 	virtual int
 	write(const void* buf, size_t len);
 
+	virtual int
+	writev(const struct iovec* iov, int iovcnt);
+
+	virtual int
+	cork(bool on);
+
 	virtual int
 	flush();
 
 	virtual bool
 	isReadable();
+
+	virtual int
+	getFd() const;
+};
+
+//the same stream calls on an AF_UNIX descriptor, which has no Nagle
+//delay to cork against
+class UnixSocket: public TcpSocket
+{
+public:
+	UnixSocket(int sd);
+
+	virtual int
+	cork(bool on);
 };
 
 class StdioSocket: public Socket
@@ -55,11 +76,23 @@ public:
 	virtual int
 	write(const void* buf, size_t len);
 
+	virtual int
+	writev(const struct iovec* iov, int iovcnt);
+
 	virtual int
 	flush();
 
+	virtual bool
+	isReliable() const;
+
 	virtual bool
 	isReadable();
+
+	virtual int
+	getFd() const;
+
+	virtual int
+	getOutputFd() const;
 };
 
 //////////////////////////////////////////////////////////////////
@@ -98,6 +131,48 @@ Socket::putc(int ch)
 	return write(&c, 1);
 }
 
+int
+Socket::writev(const struct iovec* iov, int iovcnt)
+{
+	int total = 0;
+
+	for(int i = 0; i < iovcnt; i++) {
+		if(iov[i].iov_len == 0) {
+			continue;
+		}
+
+		int n = write(iov[i].iov_base, iov[i].iov_len);
+
+		if(n < 0) {
+			return total > 0? total: -1;
+		}
+		total += n;
+
+		if((size_t) n < iov[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
+int
+Socket::cork(bool on)
+{
+	return 0;
+}
+
+bool
+Socket::isReliable() const
+{
+	return true;
+}
+
+int
+Socket::getOutputFd() const
+{
+	return getFd();
+}
+
 int
 Socket::printf(const string& fmt, ...)
 {
@@ -128,6 +203,9 @@ Socket::createInstance(const string& name, int sd)
 	if(name == "tcp") {
 		return new TcpSocket(sd);
 	}
+	if(name == "unix") {
+		return new UnixSocket(sd);
+	}
 	if(name == "stdio") {
 		return new StdioSocket();
 	}
@@ -174,6 +252,32 @@ TcpSocket::write(const void* buf, size_t len)
 	return send(sd, buf, len, MSG_NOSIGNAL);
 }
 
+int
+TcpSocket::writev(const struct iovec* iov, int iovcnt)
+{
+	struct msghdr msg;
+
+	if(sd < 0) {
+		return -1;
+	}
+	::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov    = (struct iovec*) iov;
+	msg.msg_iovlen = iovcnt;
+
+	return sendmsg(sd, &msg, MSG_NOSIGNAL);
+}
+
+int
+TcpSocket::cork(bool on)
+{
+	int n = on;
+
+	if(sd < 0) {
+		return -1;
+	}
+	return setsockopt(sd, IPPROTO_TCP, TCP_CORK, &n, sizeof(n));
+}
+
 int
 TcpSocket::flush()
 {
@@ -204,6 +308,27 @@ TcpSocket::isReadable()
 	return false;
 }
 
+int
+TcpSocket::getFd() const
+{
+	return sd;
+}
+
+//////////////////////////////////////////////////////////////////
+//
+//	class UnixSocket
+//
+
+UnixSocket::UnixSocket(int sd): TcpSocket(sd)
+{
+}
+
+int
+UnixSocket::cork(bool on)
+{
+	return Socket::cork(on);
+}
+
 //////////////////////////////////////////////////////////////////
 //
 //	class StdioSocket
@@ -229,12 +354,25 @@ StdioSocket::write(const void* buf, size_t len)
 	return ::write(1, buf, len);
 }
 
+int
+StdioSocket::writev(const struct iovec* iov, int iovcnt)
+{
+	return ::writev(1, iov, iovcnt);
+}
+
 int
 StdioSocket::flush()
 {
 	return 0;
 }
 
+bool
+StdioSocket::isReliable() const
+{
+	//a terminal may be a serial line
+	return !::isatty(0);
+}
+
 bool
 StdioSocket::isReadable()
 {
@@ -253,5 +391,17 @@ StdioSocket::isReadable()
 	return false;
 }
 
+int
+StdioSocket::getFd() const
+{
+	return 0;	//stdin
+}
+
+int
+StdioSocket::getOutputFd() const
+{
+	return 1;	//stdout
+}
+
 }; //end of namespace gdb
 
@@ -2,6 +2,7 @@
 #define __Socket__h__
 
 #include <stdarg.h>
+#include <sys/uio.h>
 #include <string>
 
 using namespace std;
@@ -41,11 +42,31 @@ namespace gdb
 		virtual int
 		write(const void* buf, size_t len) = 0;
 
+		//one write of several buffers; the default writes them in turn
+		virtual int
+		writev(const struct iovec* iov, int iovcnt);
+
+		//while corked, partial frames are held back to leave together;
+		//a no-op where the transport cannot
+		virtual int
+		cork(bool on);
+
 		virtual int
 		flush() = 0;
 
+		//the transport neither drops nor corrupts bytes, acks are of no use
+		virtual bool
+		isReliable() const;
+
 		virtual bool
 		isReadable() = 0;
+
+		virtual int
+		getFd() const = 0;
+
+		//where the replies go, when it is not getFd()
+		virtual int
+		getOutputFd() const;
 	};
 };
 
@@ -0,0 +1,81 @@
+#include "StopQueue.h"
+#include <stddef.h>
+
+namespace gdb {
+
+//intrusive MPSC list: producers swap head, the consumer walks from tail;
+//the stub node keeps the list non-empty so push never touches tail
+StopQueue::StopQueue()
+{
+	stub.next = NULL;
+	head      = &stub;
+	tail      = &stub;
+}
+
+StopQueue::~StopQueue()
+{
+	uint64_t thread;
+	int      signal;
+
+	while(pop(thread, signal)) {
+	}
+}
+
+void
+StopQueue::enqueue(StopEvent* event)
+{
+	event->next.store(NULL, memory_order_relaxed);
+
+	StopEvent* prev = head.exchange(event, memory_order_acq_rel);
+
+	//until this store the consumer sees the list end at prev
+	prev->next.store(event, memory_order_release);
+}
+
+void
+StopQueue::push(uint64_t thread, int signal)
+{
+	StopEvent* event = new StopEvent;
+
+	event->thread = thread;
+	event->signal = signal;
+	enqueue(event);
+}
+
+bool
+StopQueue::pop(uint64_t& thread, int& signal)
+{
+	StopEvent* first = tail;
+	StopEvent* next  = first->next.load(memory_order_acquire);
+
+	if(first == &stub) {
+		if(next == NULL) {
+			return false;
+		}
+		tail  = next;
+		first = next;
+		next  = next->next.load(memory_order_acquire);
+	}
+
+	if(next == NULL) {
+		if(first != head.load(memory_order_acquire)) {
+			//a producer has swapped head but not linked its event yet
+			return false;
+		}
+		//first is the last event: put the stub behind it to detach it
+		enqueue(&stub);
+		next = first->next.load(memory_order_acquire);
+
+		if(next == NULL) {
+			return false;
+		}
+	}
+
+	tail   = next;
+	thread = first->thread;
+	signal = first->signal;
+	delete first;
+	return true;
+}
+
+}; //namespace gdb
@@ -0,0 +1,45 @@
+#ifndef __StopQueue__h__
+#define __StopQueue__h__
+
+#include <stdint.h>
+#include <atomic>
+
+using namespace std;
+
+namespace gdb {
+
+	struct StopEvent
+	{
+		uint64_t           thread;	//0 if the target has no threads to name
+		int                signal;
+		atomic<StopEvent*> next;
+	};
+
+	//stop events from target threads to the session thread: any number of
+	//producers push without locks or waiting, a single consumer pops
+	class StopQueue
+	{
+		atomic<StopEvent*> head;	//last pushed, producers swap it
+		StopEvent*         tail;	//next to pop, consumer only
+		StopEvent          stub;
+
+		void
+		enqueue(StopEvent* event);
+
+	public:
+		StopQueue();
+
+		~StopQueue();
+
+		//any thread
+		void
+		push(uint64_t thread, int signal);
+
+		//consumer thread; false if empty or a push is still half way
+		bool
+		pop(uint64_t& thread, int& signal);
+	};
+
+}; //namespace gdb
+
+#endif/*__StopQueue__h__*/
@@ -0,0 +1,166 @@
+#include "Debug.h"
+#include "Trace.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+
+namespace gdb {
+
+Trace::Trace()
+{
+	header   = NULL;
+	ring     = NULL;
+	map_size = 0;
+}
+
+Trace::~Trace()
+{
+	if(header) {
+		::munmap(header, map_size);
+		header = NULL;
+		ring   = NULL;
+	}
+}
+
+Trace*
+Trace::createInstance(const string& dir, size_t capacity)
+{
+	static atomic<unsigned> sequence(0);
+
+	Trace* trace = new Trace();
+	int    fd    = -1;
+	void*  map   = MAP_FAILED;
+
+	capacity &= ~(size_t) 7;
+
+	if(capacity < 4096) {
+		capacity = 4096;
+	}
+
+	trace->map_size = sizeof(TraceHeader) + capacity;
+
+	//dir may be shared (/tmp): only a file created here is written, links are not followed
+	for(int i = 0; fd < 0; i++) {
+		trace->path = dir + "/gdbstub-" + to_string(::getpid()) + "-" + to_string(sequence++) + ".trace";
+		fd          = ::open(trace->path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+
+		if(fd < 0 && (errno != EEXIST || i + 1 >= TRACE_OPEN_ATTEMPTS)) {
+			LOG("%s: %m", trace->path.c_str());
+			goto failure;
+		}
+	}
+	if(::ftruncate(fd, trace->map_size) < 0) {
+		LOG("%s: ftruncate error: %m", trace->path.c_str());
+		goto failure;
+	}
+
+	//shared: the kernel writes the ring back, nothing is copied per record
+	map = ::mmap(NULL, trace->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if(map == MAP_FAILED) {
+		LOG("%s: mmap error: %m", trace->path.c_str());
+		goto failure;
+	}
+	::close(fd);
+
+	trace->header = (TraceHeader*) map;
+	trace->ring   = (char*) map + sizeof(TraceHeader);
+
+	trace->header->magic    = TRACE_MAGIC;
+	trace->header->capacity = capacity;
+	trace->header->head.store(0, memory_order_relaxed);
+	trace->header->tail.store(0, memory_order_release);
+	return trace;
+
+failure:
+	if(fd >= 0) {
+		::close(fd);
+	}
+	delete trace;
+	return NULL;
+}
+
+const string&
+Trace::getPath() const
+{
+	return path;
+}
+
+void
+Trace::reclaim(uint64_t head)
+{
+	uint64_t capacity = header->capacity;
+	uint64_t tail     = header->tail.load(memory_order_relaxed);
+
+	//drop the oldest records until the ring has room up to head
+	while(head - tail > capacity) {
+		size_t offset = tail % capacity;
+
+		if(capacity - offset < sizeof(TraceRecord)) {
+			tail += capacity - offset;
+			continue;
+		}
+		tail += TRACE_ALIGN(sizeof(TraceRecord) + ((TraceRecord*) (ring + offset))->size);
+	}
+	header->tail.store(tail, memory_order_release);
+}
+
+void
+Trace::record(uint32_t type, const void* buf, size_t len)
+{
+	struct iovec iov = {(void*) buf, len};
+
+	record(type, &iov, 1, len);
+}
+
+void
+Trace::record(uint32_t type, const struct iovec* iov, int iovcnt, size_t len)
+{
+	uint64_t capacity = header->capacity;
+	uint64_t head     = header->head.load(memory_order_relaxed);
+	size_t   offset   = head % capacity;
+
+	//cut what would not leave room for a second record
+	size_t size = len < capacity / 2 - sizeof(TraceRecord)? len: capacity / 2 - sizeof(TraceRecord);
+	size_t need = TRACE_ALIGN(sizeof(TraceRecord) + size);
+	size_t gap  = capacity - offset < need? capacity - offset: 0;
+
+	reclaim(head + gap + need);
+
+	if(gap >= sizeof(TraceRecord)) {
+		TraceRecord* pad = (TraceRecord*) (ring + offset);
+
+		pad->time   = 0;
+		pad->length = 0;
+		pad->size   = gap - sizeof(TraceRecord);
+		pad->type   = TRACE_PAD;
+	}
+	head += gap;
+
+	struct timespec ts;
+	TraceRecord*    record = (TraceRecord*) (ring + head % capacity);
+
+	::clock_gettime(CLOCK_REALTIME, &ts);
+
+	record->time     = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	record->length   = len;
+	record->size     = size;
+	record->type     = type;
+	record->reserved = 0;
+
+	for(char* p = (char*) (record + 1); size > 0 && iovcnt > 0; iov++, iovcnt--) {
+		size_t n = size < iov->iov_len? size: iov->iov_len;
+
+		::memcpy(p, iov->iov_base, n);
+		p    += n;
+		size -= n;
+	}
+
+	header->head.store(head + need, memory_order_release);
+}
+
+}; //namespace gdb
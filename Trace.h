@@ -0,0 +1,81 @@
+#ifndef __Trace__h__
+#define __Trace__h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+#define TRACE_MAGIC		(0x31454341525450ULL)	//"PTRACE1"
+#define TRACE_DEFAULT_SIZE	(16UL << 20)
+#define TRACE_OPEN_ATTEMPTS	(64)	//names tried when a stale file holds one
+
+//record types
+#define TRACE_PAD		(0)	//fills the end of the ring before it wraps
+#define TRACE_IN		(1)	//bytes read from the debugger
+#define TRACE_OUT		(2)	//bytes written to the debugger
+
+#define TRACE_ALIGN(n)		(((n) + 7) & ~(size_t) 7)
+
+namespace gdb {
+
+	//at offset 0 of a trace file, the ring of records follows
+	struct TraceHeader
+	{
+		uint64_t         magic;
+		uint64_t         capacity;	//bytes in the ring, a multiple of 8
+		atomic<uint64_t> head;		//bytes ever written; the next record starts at head % capacity
+		atomic<uint64_t> tail;		//oldest record kept, also a running offset
+	};
+
+	//records start 8-byte aligned and never wrap: a record that does not
+	//fit before the end of the ring goes to its start, behind a pad record,
+	//or behind nothing if not even a record header is left
+	struct TraceRecord
+	{
+		uint64_t time;		//CLOCK_REALTIME in ns
+		uint32_t length;	//bytes on the wire
+		uint32_t size;		//bytes that follow, less than length if cut
+		uint32_t type;
+		uint32_t reserved;
+	};
+
+	//captures the raw bytes of one session into a memory-mapped ring
+	//buffer: a single writer, no locks and no syscalls per record; the
+	//file can be decoded offline with tracedump
+	class Trace
+	{
+		string       path;
+		TraceHeader* header;
+		char*        ring;
+		size_t       map_size;
+
+		Trace();
+
+		void
+		reclaim(uint64_t head);
+
+	public:
+		~Trace();
+
+		//maps a new trace file in dir, never an existing one; NULL on failure
+		static Trace*
+		createInstance(const string& dir, size_t capacity = TRACE_DEFAULT_SIZE);
+
+		const string&
+		getPath() const;
+
+		void
+		record(uint32_t type, const void* buf, size_t len);
+
+		//the first len bytes of a gathered write, as one record
+		void
+		record(uint32_t type, const struct iovec* iov, int iovcnt, size_t len);
+	};
+
+}; //namespace gdb
+
+#endif/*__Trace__h__*/
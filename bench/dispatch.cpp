@@ -0,0 +1,147 @@
+//command lookup cost per packet: the former std::map probe for every
+//backward token against one forward pass through CommandTrie
+//
+//usage: bench/dispatch [million packets]
+
+#include "../CommandTrie.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace gdb;
+
+//the table gdbstub registers
+static const char* commands[] = {
+	"c", "C", "D", "g", "G", "Hc", "Hg", "m", "M", "p", "P", "q", "Q",
+	"qRcmd", "s", "T", "X", "z", "Z", "?"
+};
+
+//a session mix: memory and register traffic, queries, breakpoints
+static const char* packets[] = {
+	"m7fffffffe000,800", "m401000,40", "g", "p8", "Hg0", "Hc-1",
+	"qSupported:multiprocess+;swbreak+;hwbreak+;qRelocInsn+", "qfThreadInfo",
+	"qXfer:features:read:target.xml:0,ffb", "qRcmd,696e666f", "Z0,401136,1",
+	"z0,401136,1", "M601040,4:2a000000", "qCRC:401000,1000", "?", "vCont?", "s", "c"
+};
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//the removed Processor::getNextToken
+static bool
+getNextToken(const char* buf, const char* end, const char* &sep, string& cmd, string& param)
+{
+	int digits = 0;
+
+	if(sep == NULL) {
+		return false;
+	}
+	if(sep <= buf) {
+		sep = NULL;
+		return false;
+	}
+	for(--sep; sep >= buf; sep--) {
+		if(strchr(":;,", *sep) != NULL) {
+			cmd.assign(buf, sep - buf);
+			param.assign(sep + 1, end - sep - 1);
+			return true;
+		}
+		if(*sep == '-' || (*sep >= '0' && *sep <= '9')) {
+			digits++;
+			continue;
+		}
+		if(digits > 0) {
+			sep++;
+			cmd.assign(buf, sep - buf);
+			param.assign(sep, end - sep);
+			return true;
+		}
+	}
+	cmd.assign(buf, end - buf);
+	param = "";
+	return true;
+}
+
+static int
+lookupMap(const map<string, int>& table, const char* buf, size_t n)
+{
+	const char* end   = buf + n;
+	const char* sep   = end;
+	string      cmd   = "";
+	string      param = "";
+
+	while(sep) {
+		if(!getNextToken(buf, end, sep, cmd, param)) {
+			cmd.assign(buf, 1);
+			param.assign(buf + 1, n - 1);
+		}
+
+		map<string, int>::const_iterator found = table.find(cmd);
+
+		if(found != table.end()) {
+			return found->second;
+		}
+	}
+	return -1;
+}
+
+static int
+lookupTrie(const CommandTrie& trie, const char* buf, size_t n)
+{
+	CommandTrie::Match matches[8];
+
+	return trie.match(buf, n, matches, 8) > 0? matches[0].value: -1;
+}
+
+int
+main(int argc, char** argv)
+{
+	size_t           rounds   = (argc > 1? atoi(argv[1]): 2) * 1000000;
+	size_t           npackets = sizeof(packets) / sizeof(packets[0]);
+	size_t           lengths[sizeof(packets) / sizeof(packets[0])];
+	map<string, int> table;
+	CommandTrie      trie;
+
+	for(size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+		table[commands[i]] = i;
+		trie.insert(commands[i], i);
+	}
+	trie.compile();
+
+	for(size_t i = 0; i < npackets; i++) {
+		lengths[i] = strlen(packets[i]);
+
+		if(lookupMap(table, packets[i], lengths[i]) != lookupTrie(trie, packets[i], lengths[i])) {
+			printf("mismatch on %s\n", packets[i]);
+			return 1;
+		}
+	}
+
+	size_t sink  = 0;
+	double start = now();
+
+	for(size_t i = 0; i < rounds; i++) {
+		sink += lookupMap(table, packets[i % npackets], lengths[i % npackets]);
+	}
+
+	double mapTime = now() - start;
+
+	start = now();
+	for(size_t i = 0; i < rounds; i++) {
+		sink += lookupTrie(trie, packets[i % npackets], lengths[i % npackets]);
+	}
+
+	double trieTime = now() - start;
+
+	__asm__ __volatile__("" :: "r"(sink));
+	printf("%-8s %10.1f ns/packet\n", "map", mapTime / rounds * 1e9);
+	printf("%-8s %10.1f ns/packet %6.1fx\n", "trie", trieTime / rounds * 1e9, mapTime / trieTime);
+	return 0;
+}
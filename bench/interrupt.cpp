@@ -0,0 +1,116 @@
+//latency from gdb's Ctrl-C (0x03) to the stop reply of a running stub
+//
+//usage: gdbstub --tcp PORT & bench/interrupt [PORT [iterations]]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//reads up to and including the checksum of the next packet
+static bool
+readPacket(int sd, char* packet, size_t size)
+{
+	size_t len   = 0;
+	int    trail = -1;
+
+	while(trail != 0) {
+		char ch;
+
+		if(::read(sd, &ch, 1) != 1) {
+			return false;
+		}
+		if(len == 0 && ch != '$') {
+			continue;	//acks
+		}
+		if(len < size - 1) {
+			packet[len++] = ch;
+		}
+		if(trail > 0) {
+			trail--;
+		} else if(ch == '#') {
+			trail = 2;
+		}
+	}
+	packet[len] = '\0';
+	return true;
+}
+
+int
+main(int argc, char** argv)
+{
+	const char* port       = argc > 1? argv[1]: "1234";
+	int         iterations = argc > 2? atoi(argv[2]): 1000;
+	int         one        = 1;
+	int         sd         = -1;
+	char        packet[256];
+
+	struct addrinfo  hints;
+	struct addrinfo* ai = NULL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if(getaddrinfo("127.0.0.1", port, &hints, &ai) != 0) {
+		fprintf(stderr, "cannot resolve port %s\n", port);
+		return 1;
+	}
+	if((sd = socket(ai->ai_family, ai->ai_socktype, 0)) < 0 || connect(sd, ai->ai_addr, ai->ai_addrlen) < 0) {
+		perror("connect");
+		return 1;
+	}
+	freeaddrinfo(ai);
+	setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	vector<double> samples;
+
+	for(int i = 0; i < iterations; i++) {
+		//resume; the stub acks and stays silent while the target runs
+		if(write(sd, "$c#63", 5) != 5) {
+			perror("write");
+			return 1;
+		}
+		usleep(100);
+
+		double start = now();
+
+		if(write(sd, "\x03", 1) != 1 || !readPacket(sd, packet, sizeof(packet))) {
+			fprintf(stderr, "no stop reply\n");
+			return 1;
+		}
+		samples.push_back(now() - start);
+
+		if(write(sd, "+", 1) != 1) {
+			perror("write");
+			return 1;
+		}
+	}
+	close(sd);
+
+	sort(samples.begin(), samples.end());
+
+	printf("stop reply %s after %d interrupts\n", packet, iterations);
+	printf("%-8s %10.1f us\n", "min", samples[0] * 1e6);
+	printf("%-8s %10.1f us\n", "median", samples[samples.size() / 2] * 1e6);
+	printf("%-8s %10.1f us\n", "p99", samples[samples.size() * 99 / 100] * 1e6);
+	printf("%-8s %10.1f us\n", "max", samples.back() * 1e6);
+	return 0;
+}
@@ -0,0 +1,114 @@
+//microbenchmark of the RSP byte kernels: checksum, special byte scan, hex codecs
+//and the qSearch pattern finder
+//
+//usage: bench/kernels [total MiB per measurement]
+
+#include "../Simd.h"
+#include "../Hex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace gdb;
+
+enum {
+	CHECKSUM,
+	SCAN,
+	HEX_ENCODE,
+	HEX_DECODE,
+	FIND,
+	KERNELS
+};
+
+static const char* names[KERNELS] = {"checksum", "scan", "hexenc", "hexdec", "find"};
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t
+run(int kernel, const char* in, char* out, size_t len)
+{
+	switch(kernel) {
+		case CHECKSUM:
+			return Simd::checksum(in, len);
+		case SCAN:
+			//a payload without special bytes, the whole buffer is scanned
+			return Simd::scan(in, len);
+		case HEX_ENCODE:
+			Hex::encode(out, in, len);
+			return Simd::checksum(out, 2 * len);
+		case HEX_DECODE:
+			Hex::decode(out, in, len);
+			return Simd::checksum(out, len / 2);
+		case FIND:
+			//the first byte matches often, the last never: only the filter runs
+			return Simd::find(in, len, "0123456789abcdeg", 16);
+	}
+	return 0;
+}
+
+//GB/s of a kernel over len input bytes
+static double
+measure(int kernel, const char* in, char* out, size_t len, size_t total)
+{
+	size_t rounds = total / len + 1;
+	size_t sink   = 0;
+	double start  = now();
+
+	for(size_t i = 0; i < rounds; i++) {
+		sink += run(kernel, in, out, len);
+	}
+
+	double elapsed = now() - start;
+
+	__asm__ __volatile__("" :: "r"(sink));
+	return rounds * len / elapsed / 1e9;
+}
+
+int
+main(int argc, char** argv)
+{
+	size_t total = (argc > 1? atoi(argv[1]): 512) << 20;
+	size_t sizes[] = {4 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20};
+	size_t maxlen  = 1 << 20;
+	char*  in      = new char[maxlen];
+	char*  out     = new char[2 * maxlen];
+
+	//hex payload, as memory and register traffic is
+	for(size_t i = 0; i < maxlen; i++) {
+		in[i] = Hex::digits[rand() & 0xf];
+	}
+
+	printf("%-8s %-8s %10s %10s %10s %10s\n", "kernel", "isa", "size", "GB/s", "speedup", "check");
+
+	for(int kernel = 0; kernel < KERNELS; kernel++) {
+		for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			double base = 0;
+
+			for(int level = Simd::SCALAR; level <= Simd::AVX2; level++) {
+				if(!Simd::select(level)) {
+					continue;
+				}
+
+				double rate  = measure(kernel, in, out, sizes[s], total);
+				size_t check = run(kernel, in, out, sizes[s]);
+
+				if(level == Simd::SCALAR) {
+					base = rate;
+				}
+				printf("%-8s %-8s %9zuK %10.2f %9.1fx %10zu\n",
+					names[kernel], Simd::getName(level), sizes[s] >> 10, rate, rate / base, check);
+			}
+		}
+	}
+	delete[] in;
+	delete[] out;
+	return 0;
+}
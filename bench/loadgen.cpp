@@ -0,0 +1,453 @@
+//closed-loop load on one stub: N synthetic gdb clients each send a request,
+//wait for its reply and send the next; reports throughput and tail latency
+//as N grows, up to the point the stub saturates
+//
+//usage: bench/loadgen [--stub PATH] [--tcp PORT | --unix PATH] [--clients 1,2,4,...]
+//                     [--duration SECONDS] [--mix m=60,g=20,s=10,qfThreadInfo=5,Z=5]
+//                     [--ack]
+//
+//with --stub the stub is started for the run; otherwise one must already
+//listen on the TCP port or the unix socket
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#define REPLY_TIMEOUT_MS	(5000)
+
+//the kinds of traffic a client mixes
+struct Request
+{
+	const char* name;
+	const char* payload;
+	int         weight;
+	string      frame;
+};
+
+static Request requests[] = {
+	{"m",            "m401000,100",   60, ""},
+	{"g",            "g",             20, ""},
+	{"s",            "s",             10, ""},
+	{"qfThreadInfo", "qfThreadInfo",   5, ""},
+	{"Z",            "Z0,401136,1",    5, ""},
+};
+
+#define REQUESTS	(sizeof(requests) / sizeof(requests[0]))
+
+struct Client
+{
+	pthread_t      thread;
+	const char*    port;
+	const char*    path;	//unix socket, instead of the port
+	bool           ack;
+	unsigned       seed;
+	atomic<bool>*  stop;
+	vector<double> latency[REQUESTS];
+	bool           failed;
+};
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static string
+frame(const char* payload)
+{
+	unsigned char checksum = 0;
+	char          trailer[4];
+
+	for(const char* p = payload; *p; p++) {
+		checksum += (unsigned char) *p;
+	}
+	snprintf(trailer, sizeof(trailer), "#%02x", checksum);
+	return string("$") + payload + trailer;
+}
+
+static int
+connectTcp(const char* port, int tries)
+{
+	struct addrinfo  hints;
+	struct addrinfo* ai  = NULL;
+	int              one = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if(getaddrinfo("127.0.0.1", port, &hints, &ai) != 0) {
+		fprintf(stderr, "cannot resolve port %s\n", port);
+		return -1;
+	}
+	for(; tries > 0; tries--) {
+		int sd = socket(ai->ai_family, ai->ai_socktype, 0);
+
+		if(sd >= 0 && connect(sd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			freeaddrinfo(ai);
+			return sd;
+		}
+		if(sd >= 0) {
+			close(sd);
+		}
+		usleep(20000);
+	}
+	freeaddrinfo(ai);
+	return -1;
+}
+
+//"@name" is in the abstract namespace
+static int
+connectUnix(const char* path, int tries)
+{
+	struct sockaddr_un addr;
+	socklen_t          n = sizeof(addr);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: path too long\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	if(path[0] == '@') {
+		addr.sun_path[0] = '\0';
+		n = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+	}
+	for(; tries > 0; tries--) {
+		int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if(sd >= 0 && connect(sd, (struct sockaddr*) &addr, n) == 0) {
+			return sd;
+		}
+		if(sd >= 0) {
+			close(sd);
+		}
+		usleep(20000);
+	}
+	return -1;
+}
+
+static bool
+sendAll(int sd, const char* p, size_t n)
+{
+	while(n > 0) {
+		ssize_t w = write(sd, p, n);
+
+		if(w <= 0) {
+			return false;
+		}
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+
+//waits for the next '$' packet and drops it; buf keeps what follows
+static bool
+readReply(int sd, string& buf)
+{
+	while(true) {
+		size_t start = buf.find('$');
+		size_t end   = start == string::npos? string::npos: buf.find('#', start);
+
+		if(end != string::npos && end + 3 <= buf.length()) {
+			buf.erase(0, end + 3);
+			return true;
+		}
+
+		struct pollfd pfd = {sd, POLLIN, 0};
+		char          chunk[16384];
+
+		if(poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) {
+			return false;
+		}
+
+		ssize_t n = read(sd, chunk, sizeof(chunk));
+
+		if(n <= 0) {
+			return false;
+		}
+		buf.append(chunk, n);
+	}
+}
+
+static void*
+client(void* arg)
+{
+	Client* c      = (Client*) arg;
+	int     sd     = c->path? connectUnix(c->path, 1): connectTcp(c->port, 1);
+	int     total  = 0;
+	string  buf;
+
+	c->failed = true;
+
+	if(sd < 0) {
+		return NULL;
+	}
+	if(!c->ack) {
+		string start = frame("QStartNoAckMode");
+
+		if(!sendAll(sd, start.data(), start.length()) || !readReply(sd, buf) || !sendAll(sd, "+", 1)) {
+			goto leave;
+		}
+	}
+
+	for(size_t i = 0; i < REQUESTS; i++) {
+		total += requests[i].weight;
+	}
+
+	while(!c->stop->load(memory_order_relaxed)) {
+		//pick by weight
+		int    pick = rand_r(&c->seed) % total;
+		size_t i    = 0;
+
+		while(pick >= requests[i].weight) {
+			pick -= requests[i++].weight;
+		}
+
+		double start = now();
+
+		if(!sendAll(sd, requests[i].frame.data(), requests[i].frame.length()) || !readReply(sd, buf)) {
+			goto leave;
+		}
+		if(c->ack && !sendAll(sd, "+", 1)) {
+			goto leave;
+		}
+		c->latency[i].push_back(now() - start);
+	}
+	c->failed = false;
+
+leave:
+	close(sd);
+	return NULL;
+}
+
+static double
+percentile(const vector<double>& sorted, double q)
+{
+	if(sorted.empty()) {
+		return 0;
+	}
+
+	size_t i = (size_t) (q * sorted.size());
+
+	return sorted[i < sorted.size()? i: sorted.size() - 1];
+}
+
+//m=60,g=20: weights by name, the others drop to 0
+static bool
+parseMix(const char* mix)
+{
+	for(size_t i = 0; i < REQUESTS; i++) {
+		requests[i].weight = 0;
+	}
+
+	string all = mix;
+	size_t pos = 0;
+
+	while(pos < all.length()) {
+		size_t end = all.find(',', pos);
+		string item = all.substr(pos, end == string::npos? string::npos: end - pos);
+		size_t eq   = item.find('=');
+		size_t i    = 0;
+
+		for(; i < REQUESTS && item.substr(0, eq) != requests[i].name; i++) {
+		}
+		if(eq == string::npos || i == REQUESTS) {
+			fprintf(stderr, "unknown request in mix: %s\n", item.c_str());
+			return false;
+		}
+		requests[i].weight = atoi(item.c_str() + eq + 1);
+		pos = end == string::npos? all.length(): end + 1;
+	}
+
+	for(size_t i = 0; i < REQUESTS; i++) {
+		if(requests[i].weight > 0) {
+			return true;
+		}
+	}
+	fprintf(stderr, "empty mix\n");
+	return false;
+}
+
+int
+main(int argc, char** argv)
+{
+	const char* stub     = NULL;
+	const char* port     = "1234";
+	const char* path     = NULL;
+	const char* counts   = "1,2,4,8,16,32";
+	double      duration = 2;
+	bool        ack      = false;
+	pid_t       pid      = -1;
+
+	argc--, argv++;
+
+	for(; argc > 0; argv++, argc--) {
+		if(strcmp(*argv, "--stub") == 0 && argc > 1) {
+			stub = *++argv, argc--;
+		} else if(strcmp(*argv, "--tcp") == 0 && argc > 1) {
+			port = *++argv, argc--;
+		} else if(strcmp(*argv, "--unix") == 0 && argc > 1) {
+			path = *++argv, argc--;
+		} else if(strcmp(*argv, "--clients") == 0 && argc > 1) {
+			counts = *++argv, argc--;
+		} else if(strcmp(*argv, "--duration") == 0 && argc > 1) {
+			duration = atof(*++argv), argc--;
+		} else if(strcmp(*argv, "--mix") == 0 && argc > 1) {
+			if(!parseMix(*++argv)) {
+				return 2;
+			}
+			argc--;
+		} else if(strcmp(*argv, "--ack") == 0) {
+			ack = true;
+		} else {
+			fprintf(stderr, "usage: loadgen [--stub PATH] [--tcp PORT | --unix PATH] [--clients 1,2,4,...] [--duration SECONDS] [--mix m=60,g=20,...] [--ack]\n");
+			return 2;
+		}
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	for(size_t i = 0; i < REQUESTS; i++) {
+		requests[i].frame = frame(requests[i].payload);
+	}
+
+	if(stub) {
+		if((pid = fork()) == 0) {
+			int null = open("/dev/null", O_RDWR);
+
+			dup2(null, 1);
+			dup2(null, 2);
+			if(path) {
+				execl(stub, stub, "--unix", path, (char*) NULL);
+			} else {
+				execl(stub, stub, "--tcp", port, (char*) NULL);
+			}
+			_exit(127);
+		}
+
+		//wait until it listens
+		int sd = path? connectUnix(path, 100): connectTcp(port, 100);
+
+		if(sd < 0) {
+			fprintf(stderr, "stub does not listen on %s\n", path? path: port);
+			return 1;
+		}
+		close(sd);
+	}
+
+	printf("%8s %12s %10s %10s %10s", "clients", "requests/s", "p50 us", "p99 us", "p999 us");
+	for(size_t i = 0; i < REQUESTS; i++) {
+		if(requests[i].weight > 0) {
+			printf(" %16s", (string(requests[i].name) + " p99").c_str());
+		}
+	}
+	printf("\n");
+
+	double best         = 0;
+	int    best_clients = 0;
+	int    status       = 0;
+
+	for(const char* p = counts; *p; ) {
+		int                n = atoi(p);
+		atomic<bool>       stop(false);
+		vector<Client*>    clients;
+		vector<double>     all;
+		vector<double>     kinds[REQUESTS];
+
+		for(int i = 0; i < n; i++) {
+			Client* c = new Client;
+
+			c->port   = port;
+			c->path   = path;
+			c->ack    = ack;
+			c->seed   = i + 1;
+			c->stop   = &stop;
+			c->failed = false;
+			clients.push_back(c);
+		}
+
+		double start = now();
+
+		for(int i = 0; i < n; i++) {
+			pthread_create(&clients[i]->thread, NULL, client, clients[i]);
+		}
+		usleep(duration * 1e6);
+		stop.store(true);
+
+		for(int i = 0; i < n; i++) {
+			pthread_join(clients[i]->thread, NULL);
+		}
+
+		double elapsed = now() - start;
+		int    failed  = 0;
+
+		for(int i = 0; i < n; i++) {
+			for(size_t k = 0; k < REQUESTS; k++) {
+				kinds[k].insert(kinds[k].end(), clients[i]->latency[k].begin(), clients[i]->latency[k].end());
+			}
+			failed += clients[i]->failed;
+			delete clients[i];
+		}
+		for(size_t k = 0; k < REQUESTS; k++) {
+			all.insert(all.end(), kinds[k].begin(), kinds[k].end());
+			sort(kinds[k].begin(), kinds[k].end());
+		}
+		sort(all.begin(), all.end());
+
+		double rate = all.size() / elapsed;
+
+		printf("%8d %12.0f %10.1f %10.1f %10.1f", n, rate,
+			percentile(all, 0.5) * 1e6, percentile(all, 0.99) * 1e6, percentile(all, 0.999) * 1e6);
+		for(size_t k = 0; k < REQUESTS; k++) {
+			if(requests[k].weight > 0) {
+				printf(" %16.1f", percentile(kinds[k], 0.99) * 1e6);
+			}
+		}
+		printf(failed? "  (%d clients failed)\n": "\n", failed);
+		fflush(stdout);
+
+		if(failed) {
+			status = 1;
+		}
+		if(rate > best) {
+			best         = rate;
+			best_clients = n;
+		}
+
+		p = strchr(p, ',');
+		p = p? p + 1: "";
+	}
+	printf("saturation: %.0f requests/s at %d clients\n", best, best_clients);
+
+	if(pid > 0) {
+		kill(pid, SIGTERM);
+		waitpid(pid, NULL, 0);
+	}
+	return status;
+}
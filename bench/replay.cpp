@@ -0,0 +1,487 @@
+//replays recorded gdb sessions against the stub: packets/s, MB/s and the
+//round-trip latency of each command
+//
+//usage: bench/replay [--stub PATH] [--stdio | --tcp PORT | --unix PATH] [--repeat N] TRACE...
+//
+//a TRACE is a text file with one packet per line as gdb sends it,
+//"$payload#cs", where other lines are comments; or a binary trace written
+//by gdbstub --trace, of which the packets from gdb are replayed. With
+//--stub the stub is started for the run, over its stdin and stdout for
+//--stdio; otherwise a stub must already listen on the TCP port or the
+//unix socket.
+
+#include "../Trace.h"
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+using namespace std;
+using namespace gdb;
+
+#define REPLY_TIMEOUT_MS	(5000)
+
+struct Packet
+{
+	string payload;
+	string frame;
+	string command;		//the name latency is reported under
+};
+
+struct Connection
+{
+	int    rfd;
+	int    wfd;
+	pid_t  stub;
+	string buf;		//received, not yet parsed
+	bool   noAck;
+};
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//"m", "qSupported", "vCont", "Hg": what a packet is counted under
+static string
+commandOf(const string& payload)
+{
+	if(payload.empty()) {
+		return payload;
+	}
+	if(strchr("qQv", payload[0]) == NULL) {
+		return payload.substr(0, payload[0] == 'H'? 2: 1);
+	}
+	return payload.substr(0, payload.find_first_of(":;,?"));
+}
+
+static void
+addPacket(vector<Packet>& packets, const string& payload)
+{
+	Packet        packet;
+	unsigned char checksum = 0;
+	char          trailer[4];
+
+	for(size_t i = 0; i < payload.length(); i++) {
+		checksum += (unsigned char) payload[i];
+	}
+	snprintf(trailer, sizeof(trailer), "#%02x", checksum);
+
+	packet.payload = payload;
+	packet.frame   = "$" + payload + trailer;
+	packet.command = commandOf(payload);
+	packets.push_back(packet);
+}
+
+//every "$...#cs" in a stream, whatever is in between
+static void
+parseFrames(vector<Packet>& packets, const char* p, const char* limit)
+{
+	while((p = (const char*) memchr(p, '$', limit - p)) != NULL) {
+		const char* end = (const char*) memchr(p, '#', limit - p);
+
+		if(end == NULL || end + 3 > limit) {
+			break;
+		}
+		addPacket(packets, string(p + 1, end - p - 1));
+		p = end + 3;
+	}
+}
+
+static bool
+load(const char* path, vector<Packet>& packets)
+{
+	FILE* fp = fopen(path, "r");
+
+	if(fp == NULL) {
+		perror(path);
+		return false;
+	}
+
+	string data;
+	char   chunk[65536];
+	size_t n;
+
+	while((n = fread(chunk, 1, sizeof(chunk), fp)) > 0) {
+		data.append(chunk, n);
+	}
+	fclose(fp);
+
+	const TraceHeader* header = (const TraceHeader*) data.data();
+
+	if(data.length() >= sizeof(TraceHeader) && header->magic == TRACE_MAGIC) {
+		//walk the ring as tracedump does and keep what gdb sent
+		const char* ring     = data.data() + sizeof(TraceHeader);
+		uint64_t    capacity = header->capacity;
+		uint64_t    tail     = header->tail.load(memory_order_relaxed);
+		uint64_t    head     = header->head.load(memory_order_relaxed);
+		string      in;
+
+		if(sizeof(TraceHeader) + capacity > data.length()) {
+			fprintf(stderr, "%s: truncated trace\n", path);
+			return false;
+		}
+		while(tail < head) {
+			size_t offset = tail % capacity;
+
+			if(capacity - offset < sizeof(TraceRecord)) {
+				tail += capacity - offset;
+				continue;
+			}
+
+			const TraceRecord* record = (const TraceRecord*) (ring + offset);
+
+			if(record->type == TRACE_IN) {
+				in.append((const char*) (record + 1), record->size);
+			}
+			tail += TRACE_ALIGN(sizeof(TraceRecord) + record->size);
+		}
+		parseFrames(packets, in.data(), in.data() + in.length());
+		return true;
+	}
+
+	//text: a packet per line
+	size_t start = 0;
+
+	while(start < data.length()) {
+		size_t end = data.find('\n', start);
+
+		if(end == string::npos) {
+			end = data.length();
+		}
+		if(data[start] == '$') {
+			parseFrames(packets, data.data() + start, data.data() + end);
+		}
+		start = end + 1;
+	}
+	return true;
+}
+
+//transport is "tcp" or "unix" with its address, or NULL for stdio
+static bool
+spawn(Connection& c, const char* stub, const char* transport, const char* address)
+{
+	int in[2]  = {-1, -1};		//to the stub's stdin
+	int out[2] = {-1, -1};		//from its stdout
+
+	if(transport == NULL && (pipe(in) < 0 || pipe(out) < 0)) {
+		perror("pipe");
+		return false;
+	}
+	if((c.stub = fork()) < 0) {
+		perror("fork");
+		return false;
+	}
+	if(c.stub == 0) {
+		int null = open("/dev/null", O_RDWR);
+
+		if(transport == NULL) {
+			dup2(in[0], 0);
+			dup2(out[1], 1);
+			close(in[1]);
+			close(out[0]);
+			dup2(null, 2);
+			execl(stub, stub, "--stdio", (char*) NULL);
+		} else {
+			string option = string("--") + transport;
+
+			dup2(null, 1);
+			dup2(null, 2);
+			execl(stub, stub, option.c_str(), address, (char*) NULL);
+		}
+		_exit(127);
+	}
+	if(transport == NULL) {
+		close(in[0]);
+		close(out[1]);
+		c.wfd = in[1];
+		c.rfd = out[0];
+	}
+	return true;
+}
+
+static bool
+connectTcp(Connection& c, const char* port, bool retry)
+{
+	struct addrinfo  hints;
+	struct addrinfo* ai  = NULL;
+	int              one = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if(getaddrinfo("127.0.0.1", port, &hints, &ai) != 0) {
+		fprintf(stderr, "cannot resolve port %s\n", port);
+		return false;
+	}
+
+	//a stub just started needs a moment to listen
+	for(int tries = retry? 100: 1; tries > 0; tries--) {
+		int sd = socket(ai->ai_family, ai->ai_socktype, 0);
+
+		if(sd >= 0 && connect(sd, ai->ai_addr, ai->ai_addrlen) == 0) {
+			setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			c.rfd = c.wfd = sd;
+			freeaddrinfo(ai);
+			return true;
+		}
+		if(sd >= 0) {
+			close(sd);
+		}
+		usleep(20000);
+	}
+	perror("connect");
+	freeaddrinfo(ai);
+	return false;
+}
+
+//"@name" is in the abstract namespace
+static bool
+connectUnix(Connection& c, const char* path, bool retry)
+{
+	struct sockaddr_un addr;
+	socklen_t          n = sizeof(addr);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: path too long\n", path);
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+
+	if(path[0] == '@') {
+		addr.sun_path[0] = '\0';
+		n = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+	}
+
+	for(int tries = retry? 100: 1; tries > 0; tries--) {
+		int sd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+		if(sd >= 0 && connect(sd, (struct sockaddr*) &addr, n) == 0) {
+			c.rfd = c.wfd = sd;
+			return true;
+		}
+		if(sd >= 0) {
+			close(sd);
+		}
+		usleep(20000);
+	}
+	perror("connect");
+	return false;
+}
+
+static void
+disconnect(Connection& c)
+{
+	close(c.wfd);
+
+	if(c.rfd != c.wfd) {
+		close(c.rfd);
+	}
+	if(c.stub > 0) {
+		//a stdio stub ends at EOF, a TCP one keeps listening
+		kill(c.stub, SIGTERM);
+		waitpid(c.stub, NULL, 0);
+	}
+}
+
+static bool
+sendAll(Connection& c, const char* p, size_t n)
+{
+	while(n > 0) {
+		ssize_t w = write(c.wfd, p, n);
+
+		if(w <= 0) {
+			perror("write");
+			return false;
+		}
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+
+//the payload of the next '$' packet; acks and notifications are skipped
+static bool
+readReply(Connection& c, string& payload, uint64_t& wire)
+{
+	while(true) {
+		size_t start = c.buf.find('$');
+		size_t end   = start == string::npos? string::npos: c.buf.find('#', start);
+
+		if(end != string::npos && end + 3 <= c.buf.length()) {
+			payload.assign(c.buf, start + 1, end - start - 1);
+			wire += end + 3;
+			c.buf.erase(0, end + 3);
+			return true;
+		}
+
+		struct pollfd pfd = {c.rfd, POLLIN, 0};
+		char          chunk[65536];
+
+		if(poll(&pfd, 1, REPLY_TIMEOUT_MS) <= 0) {
+			fprintf(stderr, "no reply\n");
+			return false;
+		}
+
+		ssize_t n = read(c.rfd, chunk, sizeof(chunk));
+
+		if(n <= 0) {
+			fprintf(stderr, "stub closed the connection\n");
+			return false;
+		}
+		c.buf.append(chunk, n);
+	}
+}
+
+static bool
+replay(Connection& c, const vector<Packet>& packets, int repeat, map<string, vector<double>>& latency, uint64_t& bytes)
+{
+	string reply;
+
+	for(int r = 0; r < repeat; r++) {
+		for(size_t i = 0; i < packets.size(); i++) {
+			const Packet& packet = packets[i];
+			double        start  = now();
+
+			if(!sendAll(c, packet.frame.data(), packet.frame.length())) {
+				return false;
+			}
+			bytes += packet.frame.length();
+
+			do {
+				//console output of qRcmd precedes its OK
+				if(!readReply(c, reply, bytes)) {
+					fprintf(stderr, "after $%s\n", packet.payload.c_str());
+					return false;
+				}
+				if(!c.noAck && !sendAll(c, "+", 1)) {
+					return false;
+				}
+			} while(packet.command == "qRcmd" && reply[0] == 'O' && reply != "OK");
+
+			latency[packet.command].push_back(now() - start);
+
+			if(packet.payload == "QStartNoAckMode" && reply == "OK") {
+				c.noAck = true;
+			}
+		}
+	}
+	return true;
+}
+
+static double
+percentile(const vector<double>& sorted, double q)
+{
+	size_t i = (size_t) (q * sorted.size());
+
+	return sorted[i < sorted.size()? i: sorted.size() - 1];
+}
+
+int
+main(int argc, char** argv)
+{
+	const char* stub      = NULL;
+	const char* transport = NULL;	//stdio
+	const char* address   = NULL;
+	int         repeat    = 1;
+	int         status    = 0;
+
+	argc--, argv++;
+
+	for(; argc > 0 && strncmp(*argv, "--", 2) == 0; argv++, argc--) {
+		if(strcmp(*argv, "--stub") == 0 && argc > 1) {
+			stub = *++argv, argc--;
+		} else if(strcmp(*argv, "--tcp") == 0 && argc > 1) {
+			transport = "tcp";
+			address   = *++argv, argc--;
+		} else if(strcmp(*argv, "--unix") == 0 && argc > 1) {
+			transport = "unix";
+			address   = *++argv, argc--;
+		} else if(strcmp(*argv, "--stdio") == 0) {
+			transport = NULL;
+		} else if(strcmp(*argv, "--repeat") == 0 && argc > 1) {
+			repeat = atoi(*++argv), argc--;
+		} else {
+			break;
+		}
+	}
+	if(argc == 0 || (stub == NULL && transport == NULL)) {
+		fprintf(stderr, "usage: replay [--stub PATH] [--stdio | --tcp PORT | --unix PATH] [--repeat N] TRACE...\n");
+		return 2;
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	for(; argc > 0; argv++, argc--) {
+		vector<Packet> packets;
+		Connection     c = {-1, -1, -1, "", false};
+
+		if(!load(*argv, packets) || packets.empty()) {
+			fprintf(stderr, "%s: no packets\n", *argv);
+			status = 1;
+			continue;
+		}
+		if(stub && !spawn(c, stub, transport, address)) {
+			return 1;
+		}
+		if(transport && strcmp(transport, "tcp") == 0 && !connectTcp(c, address, stub != NULL)) {
+			disconnect(c);
+			return 1;
+		}
+		if(transport && strcmp(transport, "unix") == 0 && !connectUnix(c, address, stub != NULL)) {
+			disconnect(c);
+			return 1;
+		}
+
+		map<string, vector<double>> latency;
+		uint64_t                    bytes   = 0;
+		double                      start   = now();
+		bool                        ok      = replay(c, packets, repeat, latency, bytes);
+		double                      elapsed = now() - start;
+
+		disconnect(c);
+
+		if(!ok) {
+			fprintf(stderr, "%s: replay failed\n", *argv);
+			status = 1;
+			continue;
+		}
+
+		size_t total = packets.size() * repeat;
+
+		printf("%s over %s: %zu packets in %.3f s, %.0f packets/s, %.2f MB/s\n", *argv, transport? transport: "stdio",
+			total, elapsed, total / elapsed, bytes / elapsed / 1e6);
+		printf("  %-24s %8s %10s %10s %10s\n", "command", "count", "p50 us", "p99 us", "p999 us");
+
+		for(map<string, vector<double>>::iterator it = latency.begin(); it != latency.end(); it++) {
+			vector<double>& samples = it->second;
+
+			sort(samples.begin(), samples.end());
+			printf("  %-24s %8zu %10.1f %10.1f %10.1f\n", it->first.c_str(), samples.size(),
+				percentile(samples, 0.5) * 1e6, percentile(samples, 0.99) * 1e6, percentile(samples, 0.999) * 1e6);
+		}
+	}
+	return status;
+}
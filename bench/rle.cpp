@@ -0,0 +1,89 @@
+//bytes saved by run-length encoding 'm' replies of sparse memory dumps
+//
+//usage: bench/rle [MiB per dump]
+
+#include "../RSP.h"
+#include "../Hex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+using namespace gdb;
+
+//largest 'm' reply the stub sends with the default packet size
+#define BLOCK_SIZE		(RSP_DEFAULT_BUFFER_SIZE / 2 - 1)
+
+static double
+now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//per mille of random non-zero bytes; -1 for small 64-bit integers
+static void
+generate(char* mem, size_t len, int density)
+{
+	memset(mem, 0, len);
+
+	if(density < 0) {
+		for(size_t i = 0; i + 8 <= len; i += 8) {
+			unsigned long long word = rand() & 0xffff;
+
+			memcpy(mem + i, &word, 8);
+		}
+		return;
+	}
+	for(size_t i = 0; i < len; i++) {
+		if(rand() % 1000 < density) {
+			mem[i] = (char) (rand() | 1);
+		}
+	}
+}
+
+int
+main(int argc, char** argv)
+{
+	size_t len         = (argc > 1? atoi(argv[1]): 16) << 20;
+	int    densities[] = {0, 1, 10, 100, 500, 1000, -1};
+	char*  mem         = new char[len];
+	char*  hex         = new char[2 * BLOCK_SIZE];
+
+	printf("%-10s %12s %12s %8s %10s\n", "dump", "plain", "rle", "saved", "MB/s");
+
+	for(size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+		size_t plain   = 0;
+		size_t encoded = 0;
+		double elapsed = 0;
+
+		generate(mem, len, densities[d]);
+
+		for(size_t off = 0; off < len; off += BLOCK_SIZE) {
+			size_t n = len - off < BLOCK_SIZE? len - off: BLOCK_SIZE;
+
+			Hex::encode(hex, mem + off, n);
+
+			double start = now();
+
+			encoded += RSP::encodeRuns(hex, 2 * n) + 4;	//'$', '#' and the checksum
+			elapsed += now() - start;
+			plain   += 2 * n + 4;
+		}
+
+		char name[32];
+
+		if(densities[d] < 0) {
+			snprintf(name, sizeof(name), "words");
+		} else {
+			snprintf(name, sizeof(name), "%d.%d%%", densities[d] / 10, densities[d] % 10);
+		}
+		printf("%-10s %12zu %12zu %7.1f%% %10.0f\n",
+			name, plain, encoded, 100.0 * (plain - encoded) / plain, 2 * len / elapsed / 1e6);
+	}
+	delete[] mem;
+	delete[] hex;
+	return 0;
+}
@@ -1,16 +1,109 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <signal.h>
+#include <pthread.h>
+#include <map>
+#include <vector>
 #include "Processor.h"
+#include "Memory.h"
+#include "Crc32.h"
+#include "ResponseBuilder.h"
 
 //http://www.cims.nyu.edu/cgi-systems/info2html?(gdb)Packets
 
 using namespace gdb;
 
+//qCRC:addr,len: the slices are computed off the session loop, or on it one per turn
+class CrcJob: public Job
+{
+	Crc32::Task task;
+
+public:
+	CrcJob(Memory* memory, uint64_t addr, uint64_t len, int eventfd): task(memory, addr, len, 0xffffffff, eventfd)
+	{
+	}
+
+	virtual
+	~CrcJob()
+	{
+	}
+
+	virtual bool
+	run(RSP* rsp)
+	{
+		uint32_t crc = 0;
+
+		if(!task.poll()) {
+			return false;
+		}
+		if(!task.getResult(crc)) {
+			rsp->sendPacket("E01");
+			return true;
+		}
+		ResponseBuilder(rsp).append('C').appendInt(crc, 16, 8).finish();
+		return true;
+	}
+};
+
+//qSearch:memory:addr;len;pattern: SEARCH_SLICE_SIZE bytes a turn, each slice
+//overlapping the next by the pattern length less one
+class SearchJob: public Job
+{
+	Memory*  memory;
+	uint64_t addr;
+	uint64_t len;
+	string   pattern;
+	uint64_t done;
+
+public:
+	SearchJob(Memory* memory, uint64_t addr, uint64_t len, string_view pattern):
+		memory(memory), addr(addr), len(len), pattern(pattern), done(0)
+	{
+	}
+
+	virtual
+	~SearchJob()
+	{
+	}
+
+	virtual bool
+	run(RSP* rsp)
+	{
+		uint64_t found = 0;
+		uint64_t n     = len - done;
+
+		if(n > SEARCH_SLICE_SIZE + pattern.length() - 1) {
+			n = SEARCH_SLICE_SIZE + pattern.length() - 1;
+		}
+
+		switch(memory->search(addr + done, n, pattern.data(), pattern.length(), found)) {
+			case 1:
+				ResponseBuilder(rsp).append("1,").appendInt(found).finish();
+				return true;
+			case -1:
+				rsp->sendPacket("E01");
+				return true;
+		}
+		if(n == len - done) {
+			rsp->sendPacket("0");
+			return true;
+		}
+		done += SEARCH_SLICE_SIZE;
+
+		//the next slice on the next turn
+		rsp->wake();
+		return false;
+	}
+};
+
 class QueryHandler: public Handler
 {
+	Memory* memory;
+
 public:
-	QueryHandler()
+	QueryHandler(Memory* memory): memory(memory)
 	{
 	}
 
@@ -19,13 +112,24 @@ public:
 	{
 	}
 
+	//a job that is done in its first turn replies right away
+	static void
+	defer(RSP* rsp, Job* job)
+	{
+		if(job->run(rsp)) {
+			delete job;
+			return;
+		}
+		rsp->defer(job);
+	}
+
 	virtual bool
-	onHandle(RSP* rsp, const string& cmd, const string& param)
+	onPacket(RSP* rsp, string_view cmd, string_view param)
 	{
-		const char* p      = param.c_str();
-		string      subcmd = "";
+		string_view p = param;
+		string_view subcmd;
 
-		if(!RSP::getNextParamStr(p, subcmd)) {
+		if(!RSP::getNextParam(p, subcmd)) {
 			return false;
 		}
 		if(cmd == "Q") {
@@ -38,23 +142,39 @@ public:
 				rsp->sendPacket("OK");
 				return true;
 			}
+			if(subcmd == "NonStop") {
+				//$QNonStop:1#8d: threads stop and resume on their own
+				rsp->setNonStop(p == "1");
+				rsp->sendPacket("OK");
+				return true;
+			}
 			return false;
 		}
 
 		if(subcmd == "Xfer") {
 			//$qXfer:features:read:target.xml:0,ffa#78, l = last, m = more
-			rsp->sendPacket("l<target version=\"1.0\"><architecture>i386</architecture></target>");
+			const char* arch = memory->getArchitecture();
+
+			ResponseBuilder(rsp)
+				.append("l<target version=\"1.0\"><architecture>")
+				.append(arch? arch: "i386")
+				.append("</architecture></target>")
+				.finish();
 			return true;
 		}
 		if(subcmd == "Supported") {
 			//$qSupported:xmlRegisters=i386;qRelocInsn+#25
-			rsp->sendPacketFormat("PacketSize=%x"
-				";qXfer:libraries:read+"
-				";qXfer:features:read+"		//for registers
-			//	";qXfer:auxv:read+"
-				";QStartNoAckMode+"
-				";QPassSignals+"
-				, RSP_DEFAULT_BUFFER_SIZE - 1);
+			//gdb turns acks off by itself when QStartNoAckMode is offered,
+			//which it is on transports that do not lose bytes
+			ResponseBuilder(rsp)
+				.append("PacketSize=").appendInt(rsp->getPacketSize() - 1)
+				.append(";qXfer:libraries:read+"
+					";qXfer:features:read+"		//for registers
+				//	";qXfer:auxv:read+"
+					";QPassSignals+"
+					";QNonStop+")
+				.append(rsp->isReliable()? ";QStartNoAckMode+": "")
+				.finish();
 			return true;
 		}
 		if(subcmd == "C") {
@@ -88,7 +208,8 @@ public:
 		}
 		if(subcmd == "ThreadExtraInfo") {
 			//extra thread info
-			rsp->sendPacket(RSP::hexify("thread info la la la").c_str()); //$qThreadExtraInfo,1234#4f
+			static const char info[] = "thread info la la la";
+			rsp->sendPacketHex(info, sizeof(info) - 1); //$qThreadExtraInfo,1234#4f
 			return true;
 		}
 		if(subcmd == "L") {	//replaced by qThreadExtraInfo
@@ -101,7 +222,33 @@ public:
 			//query CRC of memory block
 			//qCRC:addr,len
 			//Ccrc32
-			return false;
+			unsigned long long addr = 0;
+			unsigned long long len  = 0;
+
+			if(!RSP::getNextParamInt(p, addr) || !RSP::getNextParamInt(p, len)) {
+				rsp->sendPacket("E00");
+				return true;
+			}
+			defer(rsp, new CrcJob(memory, addr, len, rsp->getEventFd()));
+			return true;
+		}
+		if(subcmd == "Search") {
+			//search memory for a binary pattern
+			//qSearch:memory:addr;len;pattern
+			//0 | 1,addr
+			string_view        space;
+			unsigned long long addr  = 0;
+			unsigned long long len   = 0;
+
+			if(!RSP::getNextParam(p, space) || space != "memory"
+			|| !RSP::getNextParamInt(p, addr) || !RSP::getNextParamInt(p, len) || p.empty()) {
+				rsp->sendPacket("E00");
+				return true;
+			}
+
+			//the pattern is binary and runs to the end of the packet
+			defer(rsp, new SearchJob(memory, addr, len, p));
+			return true;
 		}
 		if(subcmd == "Offsets") {
 			//get section offsets
@@ -113,18 +260,9 @@ public:
 			return false;
 		}
 		if(subcmd == "Symbol") {
-			string sym_name;
-			string sym_value;
-
-			if(!RSP::getNextParamStr(p, sym_name)) {
-				return false;
-			}
-			if(!RSP::getNextParamStr(p, sym_value)) {
-				return false;
-			}
-
-			if(sym_name == "" && sym_value == "") {
-				rsp->sendPacketFormat("qSymbol:%s", RSP::hexify("main").c_str());
+			//qSymbol:: offers symbol lookups, qSymbol:value:name answers one
+			if(p.empty() || p == ":") {
+				rsp->sendPacketHex("qSymbol:", "main", 4);
 			} else {
 				rsp->sendPacket("OK");
 			}
@@ -135,8 +273,10 @@ public:
 
 class MemoryHandler: public Handler
 {
+	Memory* memory;
+
 public:
-	MemoryHandler()
+	MemoryHandler(Memory* memory): memory(memory)
 	{
 	}
 
@@ -146,26 +286,93 @@ public:
 	}
 
 	virtual bool
-	onHandle(RSP* rsp, const string& cmd, const string& param)
+	onPacket(RSP* rsp, string_view cmd, string_view param)
 	{
+		string_view        p    = param;
+		unsigned long long addr = 0;
+		unsigned long long len  = 0;
+
+		if(!RSP::getNextParamInt(p, addr) || !RSP::getNextParamInt(p, len)) {
+			rsp->sendPacket("E00");
+			return true;
+		}
+
 		if(cmd == "m") {
-			const char* p    = param.c_str();
-			int         addr = 0; 
-			int         len  = 0; 
+			//$maddr,len: a shorter reply is fine, gdb asks again for the rest
+			static thread_local vector<char> data;
 
-			if(RSP::getNextParamInt(p, addr, 16) && RSP::getNextParamInt(p, len, 16)) {
-				string result = "";
+			if(len > (rsp->getPacketSize() - 1) / 2) {
+				len = (rsp->getPacketSize() - 1) / 2;
+			}
+			if(data.size() < len) {
+				data.resize(len);
+			}
 
-				for(; len > 0; len--) {
-					result += "00";
-				}
-				rsp->sendPacket(result.c_str());
-			} else {
-				rsp->sendPacket("E00");
+			size_t n = memory->read(addr, data.data(), len);
+
+			if(n == 0 && len > 0) {
+				rsp->sendPacket("E01");
+				return true;
+			}
+			rsp->sendPacketHex("", data.data(), n, true);
+			return true;
+		}
+
+		if(cmd == "M") {
+			//$Maddr,len:XX...: the whole payload is decoded before anything is written,
+			//so a bad digit leaves memory untouched
+			static thread_local vector<char> data;
+
+			if(len > p.length() / 2 || p.length() != 2 * len) {
+				rsp->sendPacket("E01");
+				return true;
+			}
+			if(data.size() < len) {
+				data.resize(len);
+			}
+			if(Hex::decode(data.data(), p.data(), p.length()) < 0 || memory->write(addr, data.data(), len) < len) {
+				rsp->sendPacket("E01");
+				return true;
 			}
-		} else if(cmd == "M") {
 			rsp->sendPacket("OK");
+			return true;
 		}
+
+		//$Xaddr,len:XX... with binary data, unescaped by receivePacket()
+		if(p.length() != len || memory->write(addr, p.data(), len) < len) {
+			rsp->sendPacket("E01");
+			return true;
+		}
+		rsp->sendPacket("OK");
+		return true;
+	}
+};
+
+class RegisterHandler: public Handler
+{
+	Memory* memory;
+
+public:
+	RegisterHandler(Memory* memory): memory(memory)
+	{
+	}
+
+	virtual
+	~RegisterHandler()
+	{
+	}
+
+	virtual bool
+	onPacket(RSP* rsp, string_view cmd, string_view param)
+	{
+		string_view regs;
+
+		if(memory->getRegisters(regs)) {
+			//from the PRSTATUS note of a core file
+			rsp->sendPacketHex("", regs.data(), regs.length(), true);
+			return true;
+		}
+		rsp->sendPacket("xxxxxxxx0000000100000002");
 		return true;
 	}
 };
@@ -183,68 +390,325 @@ public:
 	}
 
 	virtual bool
-	onHandle(RSP* rsp, const string& cmd, const string& param)
+	onPacket(RSP* rsp, string_view cmd, string_view param)
 	{
 		if(cmd == "C") {
-			fprintf(stderr, "send signal %s\n", param.c_str());
-			rsp->sendPacketFormat("S%s", param.c_str());
+			fprintf(stderr, "send signal %.*s\n", (int) param.length(), param.data());
+			rsp->sendPacketFormat("S%.*s", (int) param.length(), param.data());
 			return true;
 		}
 
 		if(cmd == "c") {
-			fprintf(stderr, "resume at %s...\n", param == ""? "current": param.c_str());
+			fprintf(stderr, "resume at %.*s...\n", (int) (param.empty()? 7: param.length()), param.empty()? "current": param.data());
 		}
 
-		while(true) {
-			fprintf(stderr, "continue...\n");
-
-			if(rsp->isInterrupted()) {
-				rsp->sendPacketFormat("S%02x", SIGINT);
-				break;
-			}
-			sleep(1);
+		if(rsp->isNonStop()) {
+			//stops are reported as %Stop notifications
+			rsp->sendPacket("OK");
+			return true;
 		}
+
+		//no reply now: the stop reply goes out from onStop(), on a Ctrl-C
+		//from gdb or when the target calls RSP::notifyStop()
+		rsp->setRunning(true);
+		return true;
+	}
+};
+
+class StoppedHandler: public Handler
+{
+public:
+	StoppedHandler()
+	{
+	}
+
+	virtual
+	~StoppedHandler()
+	{
+	}
+
+	virtual bool
+	onPacket(RSP* rsp, string_view cmd, string_view param)
+	{
+		//$vStopped#55: the next queued stop reply, or OK once all are out
+		rsp->sendNextStop();
 		return true;
 	}
 };
 
 class StepHandler: public Handler
 {
+	//the simulated target: every instruction is 2 bytes long and each
+	//thread has its own pc, starting where the old fixed reply put it
+	map<uint64_t, uint32_t> pcs;
+	pthread_mutex_t         lock;
+
 public:
+	enum {
+		THREAD     = 0x1234,	//the thread of 's', as reported by qC
+		FIRST_PC   = 0x06050403,
+		INSN_BYTES = 2
+	};
+
 	StepHandler()
 	{
+		::pthread_mutex_init(&lock, NULL);
 	}
 
 	virtual
 	~StepHandler()
 	{
+		::pthread_mutex_destroy(&lock);
+	}
+
+	//steps thread while its pc is in [start, end), at least once; returns the new pc
+	uint32_t
+	step(uint64_t thread, uint64_t start = 0, uint64_t end = 0)
+	{
+		::pthread_mutex_lock(&lock);
+
+		map<uint64_t, uint32_t>::iterator pc = pcs.find(thread);
+
+		if(pc == pcs.end()) {
+			pc = pcs.insert(make_pair(thread, (uint32_t) FIRST_PC)).first;
+		}
+		//the steps inside the range are taken at once: the first pc at or past end,
+		//wrapping like the 32-bit pc does, so no range can keep the loop thread
+		uint64_t next = (uint64_t) pc->second + INSN_BYTES;
+
+		if(next >= start && next < end) {
+			next += (end - next + INSN_BYTES - 1) / INSN_BYTES * INSN_BYTES;
+		}
+		pc->second = (uint32_t) next;
+
+		uint32_t result = pc->second;
+
+		::pthread_mutex_unlock(&lock);
+		return result;
+	}
+
+	int
+	sendStop(RSP* rsp, uint64_t thread, uint32_t pc)
+	{
+		//eip is register 8, little endian like the target
+		return ResponseBuilder(rsp)
+			.append('T').appendInt(SIGTRAP, 16, 2)
+			.append("05:01020304;04:02030405;08:").appendHex(&pc, sizeof(pc))
+			.append(";thread:").appendInt(thread).append(';')
+			.finish();
 	}
 
 	virtual bool
-	onHandle(RSP* rsp, const string& cmd, const string& param)
+	onPacket(RSP* rsp, string_view cmd, string_view param)
 	{
 		if(cmd == "S") {
-			fprintf(stderr, "send signal %s\n", param.c_str());
-			rsp->sendPacketFormat("S%s", param.c_str());
+			fprintf(stderr, "send signal %.*s\n", (int) param.length(), param.data());
+			rsp->sendPacketFormat("S%.*s", (int) param.length(), param.data());
 			return true;
 		}
 
 		if(cmd == "s") {
-			fprintf(stderr, "stepping at %s...\n", param == ""? "current": param.c_str());
+			fprintf(stderr, "stepping at %.*s...\n", (int) (param.empty()? 7: param.length()), param.empty()? "current": param.data());
 		}
 
-		rsp->sendPacketFormat("T%02x05:01020304;04:02030405;08:03040506;thread:1234;", SIGTRAP);
-		//rsp->sendPacketFormat("T%02x", SIGTRAP);
-		//rsp->sendPacket("OK");
+		sendStop(rsp, THREAD, step(THREAD));
+		return true;
+	}
+};
+
+class VContHandler: public Handler
+{
+	StepHandler* stepper;
+
+	//a thread-id of vCont: "-1", "tid" or "ppid.tid"; 0 stands for all
+	static bool
+	parseThread(string_view str, uint64_t& thread)
+	{
+		unsigned long long value = 0;
+
+		if(str == "-1") {
+			thread = 0;
+			return true;
+		}
+		if(!str.empty() && str[0] == 'p') {
+			size_t dot = str.find('.');
+
+			if(dot == string_view::npos) {
+				thread = 0;	//every thread of the process
+				return true;
+			}
+			str.remove_prefix(dot + 1);
+
+			if(str == "-1") {
+				thread = 0;
+				return true;
+			}
+		}
+		if(!RSP::parseInt(str, value)) {
+			return false;
+		}
+		thread = value;
+		return true;
+	}
+
+public:
+	VContHandler(StepHandler* stepper): stepper(stepper)
+	{
+	}
+
+	virtual
+	~VContHandler()
+	{
+	}
+
+	virtual bool
+	onPacket(RSP* rsp, string_view cmd, string_view param)
+	{
+		//$vCont;r1000,1010:1234;s:2000;c#xx: actions for the named threads,
+		//an action without a thread for all the others
+		bool                          running = false;
+		bool                          stopped = false;
+		uint64_t                      thread  = 0;
+		uint32_t                      pc      = 0;
+		bool                          nonStop = rsp->isNonStop();
+		vector< pair<uint64_t, int> > stops;	//non-stop: reported after the OK
+
+		if(param.empty()) {
+			rsp->sendPacket("E01");
+			return true;
+		}
+
+		while(!param.empty()) {
+			size_t             end    = param.find(';');
+			string_view        action = param.substr(0, end);
+			size_t             colon  = action.find(':');
+			uint64_t           target = StepHandler::THREAD;
+			unsigned long long start  = 0;
+			unsigned long long limit  = 0;
+
+			param.remove_prefix(end == string_view::npos? param.length(): end + 1);
+
+			if(colon != string_view::npos) {
+				if(!parseThread(action.substr(colon + 1), target)) {
+					rsp->sendPacket("E01");
+					return true;
+				}
+				action = action.substr(0, colon);
+
+				if(target == 0) {
+					target = StepHandler::THREAD;
+				}
+			}
+			if(action.empty()) {
+				rsp->sendPacket("E01");
+				return true;
+			}
+
+			switch(action[0]) {
+				case 'c':
+				case 'C':
+					running = true;
+					break;
+				case 's':
+				case 'S':
+				case 'r':
+					if(action[0] == 'r') {
+						//range stepping: keep stepping inside the stub while the pc
+						//stays in [start,end), one stop reply for the whole range
+						string_view range = action.substr(1);
+
+						if(!RSP::getNextParamInt(range, start) || !RSP::getNextParamInt(range, limit)) {
+							rsp->sendPacket("E01");
+							return true;
+						}
+					}
+					if(nonStop) {
+						stepper->step(target, start, limit);
+						stops.push_back(make_pair(target, SIGTRAP));
+					} else if(!stopped) {
+						//all-stop: the first thread to stop stops the target
+						stopped = true;
+						thread  = target;
+						pc      = stepper->step(target, start, limit);
+					}
+					break;
+				case 't':
+					//non-stop only: stop the thread, reported with signal 0
+					if(nonStop) {
+						stops.push_back(make_pair(target, 0));
+					}
+					break;
+				default:
+					rsp->sendPacket("E01");
+					return true;
+			}
+		}
+
+		if(nonStop) {
+			rsp->sendPacket("OK");
+
+			for(size_t i = 0; i < stops.size(); i++) {
+				rsp->queueStop(stops[i].second, stops[i].first);
+			}
+			return true;
+		}
+		if(stopped) {
+			stepper->sendStop(rsp, thread, pc);
+			return true;
+		}
+		if(running) {
+			//like 'c': the stop reply waits for Ctrl-C or RSP::notifyStop()
+			rsp->setRunning(true);
+			return true;
+		}
+		//only 't' actions, which all-stop ignores: nothing resumed, nothing to report
+		rsp->sendPacket("E01");
 		return true;
 	}
 };
 
 class RemoteCommandHandler: public Handler
 {
+	string traceDir;
+	size_t traceSize;
+
+	//console output, in as many 'O' packets as it takes
+	void
+	reply(RSP* rsp, const string& text)
+	{
+		size_t chunk = (rsp->getPacketSize() - 1) / 2;
+
+		for(size_t done = 0; done < text.length(); done += chunk) {
+			size_t n = text.length() - done < chunk? text.length() - done: chunk;
+
+			rsp->sendPacketHex("O", text.data() + done, n);
+		}
+	}
+
+	//monitor trace [on|off]: capture this session's traffic for tracedump
+	void
+	trace(RSP* rsp, string_view arg)
+	{
+		if(arg == "on") {
+			if(rsp->getTrace() == NULL) {
+				rsp->setTrace(Trace::createInstance(traceDir, traceSize));
+			}
+		} else if(arg == "off") {
+			rsp->setTrace(NULL);
+		} else if(!arg.empty()) {
+			reply(rsp, "usage: monitor trace [on|off]\n");
+			return;
+		}
+
+		if(rsp->getTrace() == NULL) {
+			reply(rsp, "trace off\n");
+			return;
+		}
+		reply(rsp, "trace on: " + rsp->getTrace()->getPath() + "\n");
+	}
 
 public:
-	RemoteCommandHandler()
+	RemoteCommandHandler(const string& traceDir, size_t traceSize): traceDir(traceDir), traceSize(traceSize)
 	{
 	}
 
@@ -254,20 +718,72 @@ public:
 	}
 
 	virtual bool
-	onHandle(RSP* rsp, const string& cmd, const string& param)
+	onPacket(RSP* rsp, string_view cmd, string_view param)
 	{
-		fprintf(stderr, "remote command: %s ==> %s\n", param.c_str(), RSP::unhexify(param).c_str());
-		rsp->sendPacketFormat("O%s", RSP::hexify("how are you?\n").c_str());
+		char   command[256];
+		size_t n = param.length() / 2 < sizeof(command)? param.length() / 2: sizeof(command);
+
+		if(Hex::decode(command, param.data(), 2 * n) < 0) {
+			n = 0;
+		}
+
+		//the first word names the command, the rest are its arguments
+		string_view line(command, n);
+		string_view word = line.substr(0, line.find(' '));
+		string_view args = line.substr(word.length());
+
+		while(!args.empty() && args[0] == ' ') {
+			args.remove_prefix(1);
+		}
+
+		if(word == "trace") {
+			trace(rsp, args);
+			rsp->sendPacket("OK");
+			return true;
+		}
+		if(word == "stats") {
+			//monitor stats: per command counts, bytes and latency of all workers
+			reply(rsp, Metrics::report());
+			rsp->sendPacket("OK");
+			return true;
+		}
+
+		fprintf(stderr, "remote command: %.*s ==> %.*s\n", (int) param.length(), param.data(), (int) n, command);
+		reply(rsp, "how are you?\n");
 		rsp->sendPacket("OK");
 		return true;
 	}
 };
 
+//N, NK or NM
+static size_t
+parseSize(const char* str)
+{
+	char*  unit = NULL;
+	size_t size = strtoull(str, &unit, 0);
+
+	if(*unit == 'k' || *unit == 'K') {
+		size <<= 10;
+	} else if(*unit == 'm' || *unit == 'M') {
+		size <<= 20;
+	}
+	return size;
+}
+
 int
 main(int argc, char** argv)
 {
-	const char* name   = "tcp";
-	const char* params = "1234";
+	const char* name       = "tcp";
+	const char* params     = "1234";
+	int         workers    = 1;
+	int         node       = -1;
+	size_t      packet     = RSP_DEFAULT_BUFFER_SIZE;
+	string      trace_dir  = "/tmp";
+	size_t      trace_size = TRACE_DEFAULT_SIZE;
+	bool        trace_all  = false;
+	int         stats      = 0;
+	const char* backend    = "paged";
+	const char* target     = "";
 
 	if(argc > 1) {
 		argc--, argv++;
@@ -283,16 +799,105 @@ main(int argc, char** argv)
 				params = "1234";
 				continue;
 			}
+			if(strncasecmp(*argv, "--unix", 6) == 0) {
+				//--unix PATH, or --unix @NAME in the abstract namespace
+				if(argc > 1) {
+					name   = "unix";
+					params = *++argv, argc--;
+				}
+				continue;
+			}
 			if(strncasecmp(*argv, "--stdio", 7) == 0) {
 				name   = "stdio";
 				params = "";
 				continue;
 			}
+			if(strncasecmp(*argv, "--core", 6) == 0) {
+				//postmortem: serve memory and registers of an ELF core dump
+				if(argc > 1) {
+					backend = "core";
+					target  = *++argv, argc--;
+				}
+				continue;
+			}
+			if(strncasecmp(*argv, "--image", 7) == 0) {
+				//serve a raw memory image: --image FILE[@ADDR]
+				if(argc > 1) {
+					backend = "image";
+					target  = *++argv, argc--;
+				}
+				continue;
+			}
+			if(strncasecmp(*argv, "--workers", 9) == 0) {
+				//one SO_REUSEPORT listener and session loop per worker thread
+				if(argc > 1) {
+					workers = atoi(*++argv), argc--;
+					continue;
+				}
+				workers = sysconf(_SC_NPROCESSORS_ONLN);
+				continue;
+			}
+			if(strncasecmp(*argv, "--numa", 6) == 0) {
+				//pin the workers to the CPUs and memory of a NUMA node
+				if(argc > 1) {
+					node = atoi(*++argv), argc--;
+				}
+				continue;
+			}
+			if(strncasecmp(*argv, "--packet-size", 13) == 0) {
+				//largest packet advertised in qSupported: --packet-size N[K|M]
+				if(argc > 1) {
+					size_t size = parseSize(*++argv);
+
+					argc--;
+					if(size >= RSP_DEFAULT_BUFFER_SIZE) {
+						packet = size;
+					}
+				}
+				continue;
+			}
+			if(strncasecmp(*argv, "--stats", 7) == 0) {
+				//print the command metrics to stderr every N seconds
+				if(argc > 1) {
+					stats = atoi(*++argv), argc--;
+				}
+				continue;
+			}
+			if(strncasecmp(*argv, "--trace-size", 12) == 0) {
+				//bytes kept per session trace: --trace-size N[K|M]
+				if(argc > 1) {
+					trace_size = parseSize(*++argv), argc--;
+				}
+				continue;
+			}
+			if(strncasecmp(*argv, "--trace", 7) == 0) {
+				//trace every session into DIR; 'monitor trace on' uses it too
+				if(argc > 1) {
+					trace_dir = *++argv, argc--;
+					trace_all = true;
+				}
+				continue;
+			}
 		}
 	}
 
 	Processor* processor = new Processor();
 
+	processor->setPacketSize(packet);
+
+	if(trace_all) {
+		processor->setTrace(trace_dir, trace_size);
+	}
+	if(stats > 0) {
+		Metrics::dump(stats);
+	}
+	Memory*    memory    = Memory::createInstance(backend, target);
+
+	if(memory == NULL) {
+		//the reason is logged
+		return 1;
+	}
+
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//a                      -- reserved
 	//Aarglen,argnum,arg,... -- set program arguments (reserved)
@@ -315,7 +920,8 @@ main(int argc, char** argv)
 	//F                      -- reserved
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//g                      -- read registers: REGISTER_RAW_SIZE and REGISTER_NAME
-	processor->defineResponse("g", "xxxxxxxx0000000100000002");	//$g#67
+	RegisterHandler register_handler(memory);
+	processor->defineResponse("g", &register_handler);		//$g#67
 	//GXX...                 -- write registers
 	processor->defineResponse("G", "OK");				//$G#67
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -335,7 +941,7 @@ main(int argc, char** argv)
 	//L                      -- reserved
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//maddr,len              -- read memory (addr, len)
-	MemoryHandler memory_handler;
+	MemoryHandler memory_handler(memory);
 	processor->defineResponse("m", &memory_handler); //$m0,1#fa $m0,8#01 $m0,7#00
 	//Maddr,len:XX...        -- write memory
 	processor->defineResponse("M", &memory_handler);
@@ -351,11 +957,11 @@ main(int argc, char** argv)
 	processor->defineResponse("P", "OK"); //$P8#a8
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//qquery                 -- general query
-	QueryHandler query_handler;
+	QueryHandler query_handler(memory);
 	processor->defineResponse("q", &query_handler); //$q...#xx
 	processor->defineResponse("Q", &query_handler); //$Q...#xx
 	//$qRcmd,xxxx....................xx#cc
-	RemoteCommandHandler remote_command_handler;
+	RemoteCommandHandler remote_command_handler(trace_dir, trace_size);
 	processor->defineResponse("qRcmd", &remote_command_handler);
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//r                      -- reset the entire system (deprecated)
@@ -372,14 +978,20 @@ main(int argc, char** argv)
 	//u                      -- reserved
 	//U                      -- reserved
 	//v                      -- reserved
-	//$vCont?#49
+	//vCont[;action[:thread]]...  -- resume threads: c, Csig, s, Ssig, t (stop), r start,end (range step)
+	VContHandler vcont_handler(&step_handler);
+	processor->defineResponse("vCont", &vcont_handler);
+	processor->defineResponse("vCont?", "vCont;c;C;s;S;t;r"); //$vCont?#49
+	//vStopped               -- non-stop: acknowledge a stop notification, get the next
+	StoppedHandler stopped_handler;
+	processor->defineResponse("vStopped", &stopped_handler);
 	//V                      -- reserved
 	//w                      -- reserved
 	//W                      -- reserved
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//x                      -- reserved
 	//Xaddr,len:XX...        -- write mem with (XX) binary data (addr,len:XX), (escaped)
-	processor->defineResponse("X" , "OK");
+	processor->defineResponse("X" , &memory_handler);
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 	//y                      -- reserved
 	//Y                      -- reserved
@@ -393,7 +1005,10 @@ main(int argc, char** argv)
 	processor->defineResponse("?" , "S%02x", SIGTRAP); //$?#3f
 	///////////////////////////////////////////////////////////////////////////////////////////////////////
 
-	processor->serve(name, params);
+	if(!processor->serve(name, params, workers, node)) {
+		//the reason is logged
+		return 1;
+	}
 	return 0;
 }
 
@@ -0,0 +1,129 @@
+//prints the packet traces written by gdbstub --trace or 'monitor trace on'
+//
+//usage: tracedump FILE...
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Trace.h"
+
+using namespace gdb;
+
+static void
+print(const TraceRecord* record, uint64_t previous)
+{
+	const char* p     = (const char*) (record + 1);
+	const char* limit = p + record->size;
+	time_t      sec   = record->time / 1000000000ULL;
+	struct tm   tm;
+	char        stamp[32];
+
+	localtime_r(&sec, &tm);
+	strftime(stamp, sizeof(stamp), "%H:%M:%S", &tm);
+
+	printf("%s.%09llu %+12.6f %-3s ", stamp, (unsigned long long) (record->time % 1000000000ULL),
+		previous? (record->time - previous) * 1e-9: 0.0, record->type == TRACE_IN? "in": "out");
+
+	for(; p < limit; p++) {
+		if((unsigned char) *p < 0x20 || (unsigned char) *p >= 0x7f) {
+			printf("\\x%02x", *p & 0xff);
+		} else {
+			putchar(*p);
+		}
+	}
+	if(record->size < record->length) {
+		printf(" ... (%u of %u bytes)", record->size, record->length);
+	}
+	putchar('\n');
+}
+
+static bool
+dump(const char* path)
+{
+	struct stat  st;
+	TraceHeader* header = NULL;
+	int          fd     = ::open(path, O_RDONLY | O_CLOEXEC);
+	bool         ok     = false;
+
+	if(fd < 0) {
+		perror(path);
+		return false;
+	}
+	if(::fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(TraceHeader)) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		goto leave;
+	}
+	header = (TraceHeader*) ::mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if(header == MAP_FAILED) {
+		perror(path);
+		header = NULL;
+		goto leave;
+	}
+	if(header->magic != TRACE_MAGIC || header->capacity == 0 || sizeof(TraceHeader) + header->capacity > (size_t) st.st_size) {
+		fprintf(stderr, "%s: not a trace\n", path);
+		goto leave;
+	}
+
+	{
+		const char* ring     = (const char*) (header + 1);
+		uint64_t    capacity = header->capacity;
+		uint64_t    tail     = header->tail.load(memory_order_acquire);
+		uint64_t    head     = header->head.load(memory_order_acquire);
+		uint64_t    previous = 0;
+
+		//the same walk as Trace::reclaim(), from the oldest record kept
+		while(tail < head) {
+			size_t offset = tail % capacity;
+
+			if(capacity - offset < sizeof(TraceRecord)) {
+				tail += capacity - offset;
+				continue;
+			}
+
+			const TraceRecord* record = (const TraceRecord*) (ring + offset);
+
+			if(offset + sizeof(TraceRecord) + record->size > capacity) {
+				fprintf(stderr, "%s: broken record at %llu\n", path, (unsigned long long) tail);
+				goto leave;
+			}
+			if(record->type != TRACE_PAD) {
+				print(record, previous);
+				previous = record->time;
+			}
+			tail += TRACE_ALIGN(sizeof(TraceRecord) + record->size);
+		}
+	}
+	ok = true;
+
+leave:
+	if(header) {
+		::munmap(header, st.st_size);
+	}
+	::close(fd);
+	return ok;
+}
+
+int
+main(int argc, char** argv)
+{
+	int status = 0;
+
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s FILE...\n", argv[0]);
+		return 2;
+	}
+	for(int i = 1; i < argc; i++) {
+		if(argc > 2) {
+			printf("%s:\n", argv[i]);
+		}
+		if(!dump(argv[i])) {
+			status = 1;
+		}
+	}
+	return status;
+}